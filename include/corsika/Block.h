@@ -20,6 +20,7 @@ namespace corsika
     static const size_t kParticlesInBlock  = 39;
     static const size_t kLongEntriesPerBlock = 26;
     static const size_t kSubBlocksPerBlock = 21;
+    static const size_t kParticlesInDiskBlock = kParticlesInBlock * kSubBlocksPerBlock;
     
     struct Thinned
     {
@@ -0,0 +1,26 @@
+/**
+ \file
+ Byte order conversion of 32 bit words
+
+ \note This is an internal helper for the Corsika reader.
+ */
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+namespace corsika
+{
+    /// Reverse the bytes of each of \a theCount 32 bit words from \a theInput into \a theOutput, which may be the same.
+    /// Uses the widest byte shuffle the processor has (AVX2, SSSE3, NEON), a scalar loop otherwise.
+    void SwapWords(const void* theInput, void* theOutput, size_t theCount);
+
+    inline uint32_t SwapWord(uint32_t theWord)
+    {
+        return __builtin_bswap32(theWord);
+    }
+    inline uint64_t SwapWord(uint64_t theWord)
+    {
+        return __builtin_bswap64(theWord);
+    }
+}
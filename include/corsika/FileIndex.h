@@ -2,17 +2,52 @@
 #include <corsika/RawStream.h>
 #include <vector>
 #include <map>
+#include <string>
+#include <functional>
 namespace corsika
 {
     struct FileIndex
     {
-        int runNumber;
+        int runNumber;                       ///< Of the first run
+        std::vector<size_t> runHeaders;      ///< Files can hold several runs one after the other (cat DAT* > all)
+        std::vector<size_t> runTrailers;
+        std::vector<int> runNumbers;
         std::vector<size_t> eventHeaders;
         std::vector<size_t> eventTrailers;
         std::vector<size_t> longBlocks;
-        std::map<unsigned int, unsigned int> IDToPosition;
+        std::vector<unsigned int> eventNumbers;
+        std::vector<unsigned int> eventRuns; ///< Run (index in runHeaders) of each event
+        std::map<unsigned int, unsigned int> IDToPosition; ///< Event number to index in eventHeaders, of the first run that has it
+        std::map<std::pair<int, unsigned int>, unsigned int> RunEventToPosition; ///< (run number, event number) to index in eventHeaders
+        bool complete;        ///< The end of the file was reached, after a run trailer
+        size_t scannedBlocks; ///< Block where an incremental scan continues
+        
+        FileIndex(): runNumber(0), complete(false), scannedBlocks(0) {}
         std::string String();
+        void Clear();
+        
+        /// Enter a run header at block thePosition
+        void AddRun(size_t thePosition, int theRunNumber);
+        /// Enter an event header at block thePosition, of the last run entered
+        void AddEvent(size_t thePosition, unsigned int theEventNumber);
         
+        /// Index the whole file from the start
         void Scan(RawStream& stream, bool force);
+        /// Continue scanning until nEvents events (header to trailer) are indexed or the file ends.
+        /// Non-seekable streams are scanned from their current position. Returns whether nEvents are available
+        bool ScanEvents(RawStream& stream, size_t nEvents);
+        /// Continue scanning like ScanEvents until theFound() is true, in one pass. Returns theFound()
+        bool ScanUntil(RawStream& stream, const std::function<bool()>& theFound);
+        /// Index the whole file looking at block IDs only, split into ranges scanned on separate threads.
+        /// Returns false if the stream has no random access (see RawStream::GetBlockIDs), Scan is needed then
+        bool ScanBlockIDs(const RawStream& stream, unsigned int threads = 1);
+        
+        /// Write a complete index to theIndexFile, keyed to the current state of theDataFile. Returns false on failure
+        bool Save(const std::string& theIndexFile, const std::string& theDataFile) const;
+        /// Read an index written by Save. Returns false if it is missing or theDataFile changed since
+        bool Load(const std::string& theIndexFile, const std::string& theDataFile);
+        /// Where the index of theDataFile is cached: next to it if the directory is writable,
+        /// otherwise in $XDG_CACHE_HOME/corsika (~/.cache/corsika)
+        static std::string CacheName(const std::string& theDataFile);
     };
 }
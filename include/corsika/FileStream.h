@@ -1,11 +1,57 @@
 #pragma once
 #include <stddef.h>
+#include <string>
+#include <boost/shared_ptr.hpp>
 struct FileStream
 {
+    struct Options
+    {
+        size_t read_ahead; // Chunks (1 MiB) read/decompressed ahead by a background thread. 0 reads on the caller's thread. Not used for mapped files.
+        unsigned int threads; // Threads decompressing .bz2 files. Above 1, bzip2 blocks are decompressed in parallel.
+        size_t gz_index_span; // Uncompressed bytes between the access points used to seek in .gz files. 0 uses gzseek, which re-reads the file from the start to go back.
+        bool gz_index_file; // Load and save the .gz access points in a file next to the data (name.gzidx)
+        size_t queue_depth; // Reads (1 MiB) of plain files kept in flight, with io_uring or by a pool of threads. 0 maps plain files instead
+        Options(): read_ahead(0), threads(1), gz_index_span(8 << 20), gz_index_file(false), queue_depth(0) {}
+    };
+
     const bool seekable;
     FileStream(bool seekable): seekable(seekable) {}
     virtual ~FileStream(){}
     virtual long read(size_t num, void* bytes) = 0; // Returns number of bytes read, <0 is returned for some errors
     virtual bool seek(size_t absolute_position) = 0; // Returns false on failure
-    static FileStream* open(const char* filename); // Returns null on failure
+    // Zero-copy read. Returns a pointer to the next num bytes and advances, or null if the stream can not
+    // provide them in memory (nothing is consumed in that case and read() has to be used instead)
+    virtual const void* view(size_t num) { return 0; }
+    // Random access that leaves the position of read() alone and may be called from several threads at once.
+    // read_at returns the number of bytes read, <0 if the stream does not support it. view_at returns null
+    // unless the whole range is in memory
+    virtual long read_at(size_t absolute_position, size_t num, void* bytes) { return -1; }
+    virtual const void* view_at(size_t absolute_position, size_t num) { return 0; }
+    virtual size_t size() const { return 0; } // Total size in bytes, 0 if unknown
+    // How the data will be read, passed on to the kernel (posix_fadvise, madvise) where the stream has a file
+    // underneath. length 0 goes to the end. kDontNeed drops the pages from the cache. Returns false if not supported
+    enum Advice { kNormal, kSequential, kRandom, kWillNeed, kDontNeed };
+    virtual bool advise(Advice advice, size_t offset = 0, size_t length = 0) { return false; }
+    // Returns null on failure. "-" is stdin, "archive.tar:member" (also .tar.gz etc.) a member of a tar archive
+    static FileStream* open(const char* filename, const Options& options = Options());
+    // Splits "archive:member" if there is no file of that name but the archive exists
+    static bool archive_member(const char* filename, std::string& archive, std::string& member);
+    // Seekable stream over size bytes already in memory, read in place by view(). The data must stay valid while
+    // the stream is used; the stream holds on to owner (if given) until it is destroyed
+    static FileStream* open_memory(const void* data, size_t size, const boost::shared_ptr<const void>& owner = boost::shared_ptr<const void>());
+    
+    // What a factory gets to choose a backend
+    static const size_t kMagicSize = 8;
+    struct Probe
+    {
+        const char* filename;
+        const unsigned char* magic; // the first bytes of the file
+        size_t magic_size;          // up to kMagicSize. 0 for pipes, whose data can not be read twice
+        bool seekable;              // not a pipe or socket
+    };
+    // Returns a stream for a file in its format, null if it is not. Factories must be safe to call from several threads
+    typedef FileStream* (*Factory)(const Probe& probe, const Options& options);
+    // open asks registered factories first, the last one registered before the others, then the built-in ones
+    // (gzip, bzip2, xz, zstd). Files none of them takes are read as they are.
+    static void register_factory(Factory factory);
 };
@@ -13,6 +13,7 @@
 #include <map>
 #include <vector>
 #include <fstream>
+#include <sstream>
 #include <boost/shared_ptr.hpp>
 #include <corsika/LongProfile.h>
 
@@ -39,9 +40,13 @@ namespace corsika
         
         void Close()
         {
-            if (fLongDataFile->is_open()) {fLongDataFile->close();}
+            fIsOpen = false;
+            fLongDataFile.reset();
         }
         
+        /// The file (or archive member) could be opened
+        bool IsOpen() const { return fIsOpen; }
+        
         LongProfile GetProfile(size_t event);
         
         size_t size() const { return event_count; }
@@ -63,7 +68,8 @@ namespace corsika
         size_t fNBinsParticles;
         size_t fNBinsEnergyDeposit;
         
-        boost::shared_ptr<std::ifstream> fLongDataFile;
+        bool fIsOpen;
+        boost::shared_ptr<std::istream> fLongDataFile; // the file, or the contents of an archive member
         std::vector<std::streampos> fPartProfiles;
         std::vector<std::streampos> fdEdXProfiles;
         
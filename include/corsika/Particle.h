@@ -12,12 +12,64 @@
 #include <corsika/Block.h>
 #include <cmath>
 #include <memory>
+#include <stdint.h>
 
 
 namespace corsika
 {
     typedef boost::shared_ptr<struct Particle> ParticlePtr;
     
+    /**
+     \class ParticleHistory Particle.h "corsika/Particle.h"
+     
+     \brief Records CORSIKA writes before a particle: its mother and grandmother (EHISTORY) and where a muon
+     was produced (MUADDI)
+     
+     Plain data, filled in without allocating. Records of files without thinning have weight 1.
+     
+     \ingroup corsika
+     */
+    struct ParticleHistory
+    {
+        ParticleData<Thinned> fParent;
+        ParticleData<Thinned> fGrandParent;
+        ParticleData<Thinned> fMuonInfo;
+        bool fHasParent;    ///< fParent and fGrandParent are set
+        bool fHasMuonInfo;
+    };
+    
+    /**
+     \class ParticleRecord Particle.h "corsika/Particle.h"
+     
+     \brief Compact particle for loops over many particles
+     
+     The words of a particle record with the description decoded once: PDG and CORSIKA codes,
+     hadronic generation and observation level. Trivially copyable and 36 bytes, the PDG code of
+     nuclei does not fit in less next to the seven floats. Particle is the complete type.
+     
+     \ingroup corsika
+     */
+    struct ParticleRecord
+    {
+        float fPx, fPy, fPz;    // GeV
+        float fX, fY;           // cm
+        float fTorZ;            // ns or cm
+        float fWeight;          // 1 if CORSIKA was compiled w/o thinning
+        int32_t fPDGCode;
+        uint16_t fCorsikaCode;
+        uint8_t fHadronicGeneration;
+        int8_t fObservingLevel;  // from 0, like Particle::ObservingLevel: -1 for a level digit of 0
+        
+        /// Decode a record (weight 1 without thinning)
+        static ParticleRecord Decode(const ParticleData<Thinned>& theParticle);
+        
+        float Mass() const;
+        float Momentum() const
+        { return std::sqrt(fPx*fPx + fPy*fPy + fPz*fPz); }
+        float KineticEnergy() const;
+        float TotalEnergy() const;
+    };
+    
     /**
      \class Particle Particle.h "corsika/Particle.h"
      
@@ -0,0 +1,40 @@
+/**
+ \file
+ Decoding of the particle descriptions of a whole sub-block
+
+ The description of a particle record is id * 1000 + hadronic generation * 10 + observation level.
+ These are split for all the particles of a sub-block at once, with the widest vectors the processor
+ has (AVX2, SSE2, NEON), a scalar loop otherwise.
+ */
+
+#pragma once
+#include <corsika/Block.h>
+#include <stdint.h>
+
+namespace corsika
+{
+    /**
+     \class DecodedParticles ParticleDecode.h "corsika/ParticleDecode.h"
+
+     \brief Descriptions and kinetic energies of up to a sub-block of particles, one array per quantity
+
+     The descriptions are taken as whole numbers and decoded from their absolute value, so history
+     records decode like the particles they describe. Empty records have code 0 and level -1.
+
+     \ingroup corsika
+     */
+    struct DecodedParticles
+    {
+        int32_t fCorsikaCode[kParticlesInBlock];
+        int32_t fPDGCode[kParticlesInBlock];
+        int32_t fHadronicGeneration[kParticlesInBlock];
+        int32_t fObservingLevel[kParticlesInBlock];  ///< from 0, like Particle::ObservingLevel
+        float fKineticEnergy[kParticlesInBlock];     ///< the same as Particle::KineticEnergy
+    };
+
+    /// Decode the first theCount (at most kParticlesInBlock) records of theParticles into theOutput.
+    /// Without theKineticEnergies, theOutput.fKineticEnergy is left alone
+    template <class Thinning>
+    void DecodeParticles(const ParticleData<Thinning>* theParticles, size_t theCount, DecodedParticles& theOutput,
+                         bool theKineticEnergies = true);
+}
@@ -10,24 +10,53 @@ namespace corsika
     struct VRawParticleStream
     {
         virtual boost::optional<Particle> NextParticle() = 0;
+        /// Copy the next record to theParticle without allocating, weight 1 if the file has no thinning. False at the end
+        virtual bool NextParticleData(ParticleData<Thinned>& theParticle) = 0;
+        /// Copy up to theMax records, like NextParticleData. Returns how many, 0 at the end
+        virtual size_t NextParticlesData(ParticleData<Thinned>* theParticles, size_t theMax)
+        {
+            size_t n = 0;
+            while (n != theMax && NextParticleData(theParticles[n]))
+                ++n;
+            return n;
+        }
         virtual void Rewind() = 0;
         virtual bool IsValid() const = 0;
         virtual ~VRawParticleStream(){}
         static RawParticleStreamPtr Create(RawStreamPtr stream, size_t start=0);
     };
+    /// Contiguous run of particle records handed out by RawParticleStream::NextBatch
+    template <class Thinning> struct ParticleSpan
+    {
+        const ParticleData<Thinning>* first;
+        size_t count;
+        
+        const ParticleData<Thinning>* begin() const { return first; }
+        const ParticleData<Thinning>* end() const { return first + count; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+    };
+    
     template <class Thinning> struct RawParticleStream: VRawParticleStream
     {
         RawParticleStream(RawStreamPtr stream, size_t start);
         boost::optional<Particle> NextParticle();
+        bool NextParticleData(ParticleData<Thinned>& theParticle);
+        size_t NextParticlesData(ParticleData<Thinned>* theParticles, size_t theMax);
         const ParticleData<Thinning>* GetOneParticle();
+        /// Up to max particles, at least the rest of the current sub-block and at most one disk block.
+        /// The records point into the raw stream and stay valid until it advances. Empty at the end of the particles.
+        ParticleSpan<Thinning> NextBatch(size_t max = kParticlesInDiskBlock);
         void Rewind();
         bool IsValid() const { return valid; }
 
     private:
+        bool NextParticleBlock();
+        
         RawStreamPtr stream;
         size_t start;
         size_t current_particle;
-        Block<Thinning> block;
+        const Block<Thinning>* block; // view into the raw stream, valid until it advances
         bool valid;
     };
 }
@@ -11,6 +11,8 @@
 #include <boost/shared_ptr.hpp>
 #include <corsika/Block.h>
 #include <corsika/IOException.h>
+#include <corsika/FileStream.h>
+#include <vector>
 
 namespace corsika
 {
@@ -36,17 +38,59 @@ namespace corsika
         virtual bool GetNextBlock(Block<Thinned>& theBlock) = 0;
         virtual bool GetNextBlock(Block<NotThinned>& theBlock) = 0;
         
+        /// Read one block and advance without copying it. The block stays valid until the stream advances again.
+        virtual bool GetNextBlockView(const Block<Thinned>*& theBlock) = 0;
+        virtual bool GetNextBlockView(const Block<NotThinned>*& theBlock) = 0;
+        template <class Thinning> const Block<Thinning>* GetNextBlockView()
+        {
+            const Block<Thinning>* block = 0;
+            return GetNextBlockView(block) ? block : 0;
+        }
+        
+        /// Number of blocks left in memory after the last view. They are adjacent to it and reading them does not invalidate it.
+        virtual size_t GetBufferedBlocks() const = 0;
+        
         /// Number of the block read by the next call to GetNextBlock
         virtual size_t GetNextPosition() const = 0;
         
         /// Seek to a given block, the next block will be \a thePosition
         virtual void SeekTo(size_t thePosition) = 0;
-        /// It is possible to call SeekTo
+        /// SeekTo can go back. Otherwise (pipes, stdin) it can only skip forward or back within the last disk block read
         virtual bool IsSeekable() const = 0;
+        /// SeekTo goes back by opening the file again and reading it up to the position (compressed files without access points)
+        virtual bool SeeksByReopening() const = 0;
+        
+        /// Tell the system how blocks [theFirst, theFirst + theCount) will be read, theCount 0 to the end of the file
+        virtual void Advise(FileStream::Advice theAdvice, size_t theFirst = 0, size_t theCount = 0) = 0;
+        /// Drop the file from the page cache behind the blocks read, for files that are read once
+        virtual void SetDropBehind(bool theDrop) = 0;
         
         /// This is a stream of a thinned corsika file
         virtual bool IsThinned() const = 0;
         
-        static RawStreamPtr Create(const std::string& theName);
+        /// Identification of a block: the ID and the word after it (run or event number of headers)
+        struct BlockInfo
+        {
+            BlockID fID;
+            float fWord;
+        };
+        /// Number of blocks in the file, 0 if unknown
+        virtual size_t GetNBlocks() const = 0;
+        /// Get the IDs of blocks [theFirst, theFirst + theCount) without reading the rest of them.
+        /// Leaves the stream position alone and can be called from several threads. Returns the
+        /// number of blocks filled in, 0 if the file does not support random access
+        virtual size_t GetBlockIDs(size_t theFirst, size_t theCount, BlockInfo* theInfo) const = 0;
+        /// Copy blocks [theFirst, theFirst + theCount) to theBlocks, in the byte order of this machine, like GetBlockIDs.
+        /// The positions of the first blocks of disk blocks whose record markers are wrong are added to theBadRecords.
+        /// Returns 0 if the file does not support random access or has the other thinning
+        virtual size_t GetBlocks(size_t theFirst, size_t theCount, Block<Thinned>* theBlocks, std::vector<size_t>& theBadRecords) const = 0;
+        virtual size_t GetBlocks(size_t theFirst, size_t theCount, Block<NotThinned>* theBlocks, std::vector<size_t>& theBadRecords) const = 0;
+        
+        static RawStreamPtr Create(const std::string& theName, const FileStream::Options& theOptions = FileStream::Options());
+        /// Stream over a file already in memory (not compressed), read in place. \a theOwner, if given, keeps the
+        /// data alive as long as the stream (use the aliasing constructor of shared_ptr to point into a container).
+        /// Without it the caller has to.
+        static RawStreamPtr Create(const void* theData, size_t theSize,
+                                   const boost::shared_ptr<const void>& theOwner = boost::shared_ptr<const void>());
     };
 }
@@ -67,6 +67,13 @@ namespace corsika
         const EventTrailer& GetEventTrailer() const
         { return fEventTrailer; }
         
+        /// The trailer comes after the particles. Files read in a single pass only know it at the end
+        void SetEventTrailer(const EventTrailer& trailer)
+        {
+            fEventTrailer = trailer;
+            fMuonNumber = trailer.fMuons;
+        }
+        
         std::vector<double> fdEdX;
         std::vector<double> fChargeProfile;
         std::vector<double> fGammaProfile;
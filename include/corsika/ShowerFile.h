@@ -41,23 +41,46 @@ namespace corsika
         
         virtual ~ShowerFile() {}
         
-        /// Open file
+        /// Open file. With scan, the whole file is indexed right away. Otherwise the index
+        /// grows as needed: FindEvent scans up to the requested event, GetNEvents to the end
         virtual void Open(const std::string& theFileName, bool scan = true);
         
+        /// Open file to read it once in file order with NextEvent. Nothing is read twice, so this works
+        /// for pipes and stdin ("-"). Open switches to this mode by itself for files without random access
+        virtual void OpenStream(const std::string& theFileName);
+        
         /// Close file
         virtual void Close();
         
-        /// Find an event and position to read it
+        /// Find an event and position to read it. Only events further ahead can be found in streaming mode.
+        /// In files with several runs, this is the first event with that number
         virtual Status FindEvent(unsigned int eventId);
         
-        /// Get number of showers in file
+        /// Find an event of the given run, for files with several runs one after the other (cat DAT* > all)
+        virtual Status FindEvent(int theRunNumber, unsigned int theEventId);
+        
+        /// Read the next event in the file. In streaming mode, its particles can be read once before the next
+        /// call, while the trailer and longitudinal profile are only filled in by FinishEvent
+        virtual Status NextEvent();
+        
+        /// Streaming mode: skip the particles left in the current event and read its profile and trailer
+        virtual Status FinishEvent();
+        
+        /// Get number of showers in file, in all runs
         virtual size_t GetNEvents();
         
+        /// Get number of runs in file
+        virtual size_t GetNRuns();
+        
         
         /// File is open
         bool IsOpen()
         { return bool(fRawStream); }
         
+        /// File is read once in file order
+        bool IsStreaming() const
+        { return fStreaming; }
+        
         /// File is valid
         static bool IsValid(const std::string& theFileName);
         
@@ -65,12 +88,19 @@ namespace corsika
         const Shower& GetCurrentShower() const {return fCurrentShower;}
         Shower& GetCurrentShower() {return fCurrentShower;}
         
-        /// Get the run header
+        /// Get the header of the run of the current event (of the first run before an event is read)
         const corsika::RunHeader& GetRunHeader() const { return fRunHeader; }
         
+        /// Get the header of run number theRun in file order, counting from 0. Only runs that were
+        /// reached can be asked for in streaming mode. Moves the read position, like FindEvent
+        const corsika::RunHeader& GetRunHeader(size_t theRun);
+        
         /// Shower is thinned
         const bool IsThinned() const { return fIsThinned; }
         
+        /// Keep the file index in a cache (see FileIndex::CacheName) instead of scanning the file on every Open
+        void SetIndexCache(bool useCache) { fUseIndexCache = useCache; }
+        
     private:
         typedef std::vector<size_t> PositionVector;
         typedef std::map<unsigned int, unsigned int> IdToPositionMap;
@@ -78,21 +108,41 @@ namespace corsika
         template <class Thinning>
         Status ReadRunHeader();
         template <class Thinning>
+        Status ReadRunHeader(unsigned int theRun);
+        Status SelectRun(unsigned int theRun);
+        template <class Key>
+        Status FindIndexed(const std::map<Key, unsigned int>& thePositions, const Key& theKey);
+        template <class Thinning>
         Status Read();
         Status ReadLongFile();
         template <class Thinning>
         Status ReadLongBlocks();
+        template <class Thinning>
+        Status ReadLongBlocks(const Block<Thinning>* block);
+        template <class Thinning>
+        Status NextStreamEvent();
+        template <class Thinning>
+        Status FinishStreamEvent();
+        double GetTimeShift(const EventHeader& header);
+        void OpenRawStream(const std::string& theFileName);
+        void ScanFile(size_t nEvents = size_t(-1));
+        void ScanFile(const std::function<bool()>& theFound, bool theAll);
         
         Shower fCurrentShower;
-        corsika::RunHeader fRunHeader;
+        corsika::RunHeader fRunHeader;                     ///< Of run fCurrentRun
+        std::map<unsigned int, corsika::RunHeader> fRunHeaders; ///< The runs read so far, by index in the file
+        unsigned int fCurrentRun;
         
         RawStreamPtr fRawStream;
+        std::string fFileName;
         std::string fLongFile;
         FileIndex fIndex;
         unsigned int fCurrentPosition;
         unsigned int fObservationLevel;
         bool fIsThinned;
-        bool fFileScanned;
+        bool fStreaming;
+        bool fEventOpen; // streaming: the trailer of the current event was not read yet
+        bool fUseIndexCache;
         
         boost::shared_ptr<LongFile> fCorsikaLongFile;
     };
@@ -1,5 +1,6 @@
 #pragma once
 #include <corsika/RawParticleStream.h>
+#include <corsika/ParticleDecode.h>
 #include <boost/optional.hpp>
 
 namespace corsika
@@ -9,16 +10,33 @@ namespace corsika
     //
     struct ShowerParticleStream
     {
-        ShowerParticleStream(){}
+        ShowerParticleStream(): fNext(0), fCount(0) {}
         ShowerParticleStream(RawStreamPtr stream, size_t start, double timeOffset, int observationLevel, bool keepMuProd);
-        virtual void Rewind() { stream->Rewind(); }
+        virtual void Rewind() { stream->Rewind(); fNext = fCount = 0; }
         boost::optional<Particle> NextParticle();
+        /// Next particle, like NextParticle, without allocating: theParticle gets its record (weight 1 without
+        /// thinning, time relative to the observation level) and theHistory the records before it. False at the end
+        bool NextParticle(ParticleData<Thinned>& theParticle, ParticleHistory& theHistory);
+        /// Next particle as a compact record, without its history. False at the end
+        bool NextParticle(ParticleRecord& theParticle);
+        /// Up to theMax particles as compact records, without their history. Returns how many, 0 at the end
+        size_t NextParticles(ParticleRecord* theParticles, size_t theMax);
         
     private:
+        bool Next(ParticleData<Thinned>& theParticle, ParticleHistory* theHistory);
+        bool NextBatch();
+        void MakeRecord(const ParticleData<Thinned>& theParticle, ParticleRecord& theRecord) const;
+        
         boost::optional<Particle> value_;
         RawParticleStreamPtr stream;
         double fTimeOffset;
         int fObservationLevel;
         bool fKeepMuProd;
+        
+        // records read ahead from the raw stream, decoded a sub-block at a time
+        ParticleData<Thinned> fBatch[kParticlesInBlock];
+        DecodedParticles fDecoded;
+        size_t fNext;  // in fBatch, the one after the last particle returned
+        size_t fCount;
     };
 }
@@ -0,0 +1,46 @@
+/**
+ \file
+ Integrity check of Corsika files
+
+ Checks a whole file without interpreting the showers in it: the record
+ markers around disk blocks, the order of the blocks (run header, event
+ header, particles, longitudinal blocks, event trailer, run trailer),
+ the number of events against the run trailers and the particle blocks
+ for NaN and infinite words. Files with random access are checked on
+ several threads, each one taking a range of disk blocks.
+ */
+
+#pragma once
+#include <corsika/RawStream.h>
+#include <string>
+#include <vector>
+
+namespace corsika
+{
+    /**
+     \class VerifyReport Verify.h "corsika/Verify.h"
+
+     \brief What Verify found in a file
+
+     \ingroup corsika
+     */
+    struct VerifyReport
+    {
+        size_t fBlocks;    ///< Sub-blocks checked
+        size_t fRuns;
+        size_t fEvents;
+        size_t fParticles; ///< Entries of particle blocks with a particle description
+        size_t fNonFinite; ///< Words of particle blocks that are NaN or infinite
+        size_t fNErrors;   ///< Problems found. The first ones are described in fErrors, in file order
+        std::vector<std::string> fErrors;
+
+        VerifyReport(): fBlocks(0), fRuns(0), fEvents(0), fParticles(0), fNonFinite(0), fNErrors(0) {}
+        bool IsValid() const { return !fNErrors; }
+    };
+
+    /// Check the file read by theStream, from its start. theThreads 0 uses one thread per core.
+    /// Streams without random access are read once in file order, on one thread
+    VerifyReport Verify(RawStream& theStream, unsigned int theThreads = 0);
+    /// Check the file theFileName. A file that can not be opened is reported as an error
+    VerifyReport Verify(const std::string& theFileName, unsigned int theThreads = 0);
+}
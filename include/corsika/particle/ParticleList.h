@@ -29,21 +29,44 @@ namespace corsika
     {
         const VParticleProperties& operator()(int code) const { return ParticleList::Get(code); }
         
+        /// Properties of the particle with PDG code. Thread-safe
         static const VParticleProperties& Get(int code);
         
         /// Convert Corsika particle code to PDG
-        static int CorsikaToPDG(int theCorsikaCode);
+        static int CorsikaToPDG(int theCorsikaCode)
+        {
+            if (theCorsikaCode < 0) return 0;
+            if (unsigned(theCorsikaCode) < kNCorsikaCodes) return corsikaCodes_[theCorsikaCode].fPDGCode;
+            if (theCorsikaCode < 9900) return NucleusProperties::TypeCode(theCorsikaCode % 100, theCorsikaCode / 100);
+            return 0; // Cherenkov photons
+        }
+        
+        /// Mass of the particle with this Corsika code, the same as Get(CorsikaToPDG(theCorsikaCode)).GetMass()
+        /// without looking it up. Nuclei are A proton masses, like in NucleusProperties
+        static double CorsikaMass(int theCorsikaCode)
+        {
+            if (theCorsikaCode < 0) return 0;
+            if (unsigned(theCorsikaCode) < kNCorsikaCodes) return corsikaCodes_[theCorsikaCode].fMass;
+            if (theCorsikaCode < 9900) return (theCorsikaCode / 100) * protonMass_;
+            return 0;
+        }
         
         static std::string NameFromPDG(int pdgCode);
         static std::string NameFromCorsika(int corsikaCode);
         
     private:
-        static void InitCorsikaToPDGMap();
+        /// The particles, built on first use. Immutable afterwards, so it can be read from any thread
+        static const std::map<int, ParticleProperties>& GetList();
         
-        static void SetList();
+        // Corsika codes below 100 are particles, the rest nuclei (100 A + Z) or Cherenkov photons
+        static const unsigned int kNCorsikaCodes = 100;
+        struct CorsikaCode
+        {
+            int fPDGCode;
+            double fMass;
+        };
+        static const CorsikaCode corsikaCodes_[kNCorsikaCodes];
+        static const double protonMass_;
         
-        static std::map<int, int> corsikaToPDGMap_;
-        static std::map<int, ParticleProperties> particles_;
-        static std::map<int, NucleusProperties> nuclei_;
     };
 }
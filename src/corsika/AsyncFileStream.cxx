@@ -0,0 +1,347 @@
+/**
+ \file
+ Reader for plain files that keeps several reads in flight
+
+ Chunks ahead of the read position are requested before they are
+ needed, up to the queue depth, so that fast storage sees more than one
+ request at a time. With liburing (CORSIKA_HAVE_LIBURING, set by the
+ CMake option CORSIKA_USE_LIBURING, off by default) each file gets an
+ io_uring. Without it, or if the kernel refuses one, the reads
+ are made by a pool of threads shared by all files, so that reads of
+ several files are in flight at once as well.
+ */
+#include <corsika/FileStream.h>
+#include "FileAdvice.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef CORSIKA_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+using corsika::detail::fadvice;
+
+namespace
+{
+    const size_t kChunkSize = 1 << 20;
+    const size_t kMaxThreads = 64;
+
+    // A read in flight. It is shared with whoever makes the read, a seek can drop it before it completes
+    struct Request
+    {
+        size_t offset;
+        std::vector<char> data;
+        long result;
+        bool done;
+        Request(size_t offset, size_t size): offset(offset), data(size), result(0), done(false) {}
+    };
+    typedef std::shared_ptr<Request> RequestPtr;
+
+    // An open file, shared with the reads made by the pool. It is closed after the last of them
+    struct File
+    {
+        int fd;
+        std::mutex mutex;
+        std::condition_variable cond; // signals completed requests
+        File(int fd): fd(fd) {}
+        ~File() { close(fd); }
+    };
+    typedef std::shared_ptr<File> FilePtr;
+
+    long pread_all(int fd, void* bytes, size_t num, size_t offset)
+    {
+        size_t total = 0;
+        while (total < num)
+        {
+            const ssize_t n = pread(fd, (char*)bytes + total, num - total, offset + total);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) return total ? long(total) : -1;
+            if (!n) break;
+            total += n;
+        }
+        return total;
+    }
+
+    // Threads making the reads of all files
+    struct ReadPool
+    {
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::deque<std::function<void()> > tasks;
+        std::vector<std::thread> threads;
+        bool stop;
+
+        ReadPool(): stop(false) {}
+        ~ReadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+            }
+            cond.notify_all();
+            for (size_t i = 0; i != threads.size(); ++i) threads[i].join();
+        }
+        static ReadPool& instance()
+        {
+            static ReadPool pool;
+            return pool;
+        }
+        // Makes sure there are enough threads for a file that keeps n reads in flight
+        void reserve(size_t n)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (threads.size() < std::min(n, kMaxThreads))
+                threads.push_back(std::thread(&ReadPool::work, this));
+        }
+        void post(const std::function<void()>& task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                tasks.push_back(task);
+            }
+            cond.notify_one();
+        }
+        void work()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true)
+            {
+                cond.wait(lock, [this] { return stop || !tasks.empty(); });
+                if (stop) return;
+                std::function<void()> task;
+                task.swap(tasks.front());
+                tasks.pop_front();
+                lock.unlock();
+                task();
+                lock.lock();
+            }
+        }
+    };
+
+    void pool_read(FilePtr file, RequestPtr request)
+    {
+        const long result = pread_all(file->fd, &request->data[0], request->data.size(), request->offset);
+        std::lock_guard<std::mutex> lock(file->mutex);
+        request->result = result;
+        request->done = true;
+        file->cond.notify_all();
+    }
+}
+
+struct AsyncFileStream: FileStream
+{
+    FilePtr file;
+    int fd;
+    size_t length;
+    size_t depth;
+    std::deque<RequestPtr> queue; // in file order, the read position is in the first one
+    size_t offset;                // of the read position in the first request
+    size_t next_offset;           // of the next chunk to request
+    long status;
+#ifdef CORSIKA_HAVE_LIBURING
+    struct io_uring ring;
+    bool use_ring;
+    std::vector<RequestPtr> in_flight; // submitted to the ring, kept alive until they complete
+#endif
+
+    AsyncFileStream(int fd, size_t length, size_t depth):
+    FileStream(true), file(new File(fd)), fd(fd), length(length), depth(depth), offset(0), next_offset(0), status(0)
+    {
+#ifdef CORSIKA_HAVE_LIBURING
+        use_ring = io_uring_queue_init(depth, &ring, 0) == 0;
+        if (!use_ring)
+#endif
+            ReadPool::instance().reserve(depth);
+        fill();
+    }
+    ~AsyncFileStream()
+    {
+#ifdef CORSIKA_HAVE_LIBURING
+        if (use_ring)
+        {
+            // the kernel still writes into their buffers
+            while (!in_flight.empty())
+            {
+                io_uring_cqe* cqe;
+                const int ret = io_uring_wait_cqe(&ring, &cqe);
+                if (!ret) reap(cqe);
+                else if (ret != -EINTR) break;
+            }
+            io_uring_queue_exit(&ring);
+        }
+#endif
+        // reads made by the pool hold on to their request and the file
+    }
+
+    void submit(const RequestPtr& request)
+    {
+#ifdef CORSIKA_HAVE_LIBURING
+        if (use_ring)
+        {
+            io_uring_cqe* cqe;
+            while (io_uring_peek_cqe(&ring, &cqe) == 0) reap(cqe); // make room for dropped requests
+            io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+            if (sqe)
+            {
+                io_uring_prep_read(sqe, fd, &request->data[0], request->data.size(), request->offset);
+                io_uring_sqe_set_data(sqe, request.get());
+                in_flight.push_back(request);
+                io_uring_submit(&ring);
+            }
+            else
+            {
+                request->result = pread_all(fd, &request->data[0], request->data.size(), request->offset);
+                request->done = true;
+            }
+            return;
+        }
+#endif
+        ReadPool::instance().post(std::bind(pool_read, file, request));
+    }
+#ifdef CORSIKA_HAVE_LIBURING
+    void reap(io_uring_cqe* cqe)
+    {
+        Request* request = static_cast<Request*>(io_uring_cqe_get_data(cqe));
+        request->result = cqe->res < 0 ? -1 : cqe->res;
+        io_uring_cqe_seen(&ring, cqe);
+        // reads can come back short, the rest is read here
+        if (request->result >= 0 && size_t(request->result) < request->data.size())
+        {
+            const long more = pread_all(fd, &request->data[request->result], request->data.size() - request->result,
+                                        request->offset + request->result);
+            if (more > 0) request->result += more;
+        }
+        request->done = true;
+        for (size_t i = 0; i != in_flight.size(); ++i)
+        {
+            if (in_flight[i].get() == request)
+            {
+                in_flight[i].swap(in_flight.back());
+                in_flight.pop_back(); // may free a dropped request
+                break;
+            }
+        }
+    }
+#endif
+    void wait(const Request& request)
+    {
+#ifdef CORSIKA_HAVE_LIBURING
+        if (use_ring)
+        {
+            while (!request.done)
+            {
+                const int ret = io_uring_submit_and_wait(&ring, 1);
+                if (ret < 0 && ret != -EINTR) return; // request.done stays false, read() fails
+                io_uring_cqe* cqe;
+                while (io_uring_peek_cqe(&ring, &cqe) == 0) reap(cqe);
+            }
+            return;
+        }
+#endif
+        std::unique_lock<std::mutex> lock(file->mutex);
+        file->cond.wait(lock, [&request] { return request.done; });
+    }
+
+    // Requests chunks until depth of them are queued
+    void fill()
+    {
+        while (queue.size() < depth && next_offset < length)
+        {
+            const size_t size = std::min(kChunkSize, length - next_offset);
+            queue.push_back(RequestPtr(new Request(next_offset, size)));
+            submit(queue.back());
+            next_offset += size;
+        }
+    }
+    // The first request, with data left at offset. Null at the end of the file or on errors
+    const Request* front()
+    {
+        while (!queue.empty())
+        {
+            const Request& request = *queue.front();
+            wait(request);
+            if (!request.done || request.result < 0)
+            {
+                status = -1;
+                return 0;
+            }
+            if (offset < size_t(request.result)) return &request;
+            if (size_t(request.result) < request.data.size()) return 0; // the file got shorter
+            offset -= request.data.size();
+            queue.pop_front();
+            fill();
+        }
+        return 0;
+    }
+
+    long read(size_t num, void* bytes)
+    {
+        size_t total = 0;
+        while (total < num)
+        {
+            const Request* request = front();
+            if (!request) return total ? long(total) : status;
+            const size_t n = std::min(num - total, size_t(request->result) - offset);
+            memcpy((char*)bytes + total, &request->data[offset], n);
+            offset += n;
+            total += n;
+        }
+        return total;
+    }
+    bool seek(size_t absolute_position)
+    {
+        if (absolute_position > length) return false;
+        // requests before the new position are dropped, those after it are kept if it is in one of them
+        while (!queue.empty() && absolute_position >= queue.front()->offset + queue.front()->data.size())
+            queue.pop_front();
+        if (queue.empty() || absolute_position < queue.front()->offset)
+        {
+            queue.clear();
+            next_offset = absolute_position / kChunkSize * kChunkSize;
+        }
+        offset = absolute_position - (queue.empty() ? next_offset : queue.front()->offset);
+        status = 0;
+        fill();
+        return true;
+    }
+    const void* view(size_t num)
+    {
+        const Request* request = front();
+        if (!request || num > size_t(request->result) - offset) return 0;
+        const char* p = &request->data[offset];
+        offset += num;
+        return p;
+    }
+    long read_at(size_t absolute_position, size_t num, void* bytes)
+    {
+        return pread_all(fd, bytes, num, absolute_position);
+    }
+    size_t size() const { return length; }
+    bool advise(Advice advice, size_t offset, size_t length)
+    {
+        return posix_fadvise(fd, offset, length, fadvice(advice)) == 0;
+    }
+};
+
+FileStream* open_async(const char* filename, size_t depth)
+{
+    const int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat s;
+    if (fstat(fd, &s) || !S_ISREG(s.st_mode))
+    {
+        close(fd);
+        return 0;
+    }
+    return new AsyncFileStream(fd, s.st_size, std::max<size_t>(depth, 1));
+}
@@ -0,0 +1,103 @@
+/**
+ \file
+ Byte order conversion of 32 bit words
+
+ On x86 the kernel is picked at run time, the library is built for the
+ baseline instruction set (SSE2, or the scalar loop in 32 bit builds
+ without it).
+ */
+#include <corsika/ByteSwap.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CORSIKA_SWAP_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+    void swap_scalar(const uint32_t* in, uint32_t* out, size_t n)
+    {
+        for (size_t i = 0; i != n; ++i)
+            out[i] = __builtin_bswap32(in[i]);
+    }
+
+#ifdef CORSIKA_SWAP_X86
+    __attribute__((target("avx2"))) void swap_avx2(const uint32_t* in, uint32_t* out, size_t n)
+    {
+        const __m256i order = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                               3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            const __m256i words = _mm256_loadu_si256((const __m256i*)(in + i));
+            _mm256_storeu_si256((__m256i*)(out + i), _mm256_shuffle_epi8(words, order));
+        }
+        swap_scalar(in + i, out + i, n - i);
+    }
+
+    __attribute__((target("ssse3"))) void swap_ssse3(const uint32_t* in, uint32_t* out, size_t n)
+    {
+        const __m128i order = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            const __m128i words = _mm_loadu_si128((const __m128i*)(in + i));
+            _mm_storeu_si128((__m128i*)(out + i), _mm_shuffle_epi8(words, order));
+        }
+        swap_scalar(in + i, out + i, n - i);
+    }
+
+#ifdef __SSE2__
+    // no byte shuffle before SSSE3: swap the 16 bit halves, then the bytes in them
+    void swap_sse2(const uint32_t* in, uint32_t* out, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128i words = _mm_loadu_si128((const __m128i*)(in + i));
+            words = _mm_shufflehi_epi16(_mm_shufflelo_epi16(words, 0xb1), 0xb1);
+            words = _mm_or_si128(_mm_slli_epi16(words, 8), _mm_srli_epi16(words, 8));
+            _mm_storeu_si128((__m128i*)(out + i), words);
+        }
+        swap_scalar(in + i, out + i, n - i);
+    }
+#endif
+
+    typedef void (*Kernel)(const uint32_t*, uint32_t*, size_t);
+    Kernel select_kernel()
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return swap_avx2;
+        if (__builtin_cpu_supports("ssse3")) return swap_ssse3;
+#ifdef __SSE2__
+        return swap_sse2;
+#else
+        return swap_scalar;
+#endif
+    }
+#elif defined(__ARM_NEON)
+    void swap_neon(const uint32_t* in, uint32_t* out, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+            vst1q_u8((uint8_t*)(out + i), vrev32q_u8(vld1q_u8((const uint8_t*)(in + i))));
+        swap_scalar(in + i, out + i, n - i);
+    }
+#endif
+}
+
+namespace corsika
+{
+    void SwapWords(const void* theInput, void* theOutput, size_t theCount)
+    {
+#ifdef CORSIKA_SWAP_X86
+        static const Kernel kernel = select_kernel();
+        kernel((const uint32_t*)theInput, (uint32_t*)theOutput, theCount);
+#elif defined(__ARM_NEON)
+        swap_neon((const uint32_t*)theInput, (uint32_t*)theOutput, theCount);
+#else
+        swap_scalar((const uint32_t*)theInput, (uint32_t*)theOutput, theCount);
+#endif
+    }
+}
@@ -0,0 +1,23 @@
+/**
+ \file
+ Access advice of FileStream for the kernel
+
+ \note This is an internal helper of the file streams, it is not installed.
+ */
+
+#pragma once
+#include <corsika/FileStream.h>
+#include <fcntl.h>
+
+namespace corsika
+{
+    namespace detail
+    {
+        /// The posix_fadvise advice for theAdvice
+        inline int fadvice(FileStream::Advice theAdvice)
+        {
+            const int map[] = {POSIX_FADV_NORMAL, POSIX_FADV_SEQUENTIAL, POSIX_FADV_RANDOM, POSIX_FADV_WILLNEED, POSIX_FADV_DONTNEED};
+            return map[theAdvice];
+        }
+    }
+}
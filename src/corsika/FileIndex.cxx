@@ -1,15 +1,99 @@
 #include <corsika/FileIndex.h>
 #include <sstream>
+#include <algorithm>
+#include <future>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <boost/filesystem.hpp>
 
 using namespace corsika;
 
+namespace bfs = boost::filesystem;
+
+namespace
+{
+    const char kIndexMagic[8] = {'C', 'R', 'S', 'K', 'I', 'D', 'X', '2'};
+    const size_t kHashedBytes = 1 << 16;
+    
+    uint64_t Hash(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL)
+    {
+        for (size_t i = 0; i != size; ++i)
+        {
+            hash ^= ((const unsigned char*)data)[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+    
+    // Identifies the state of a data file: size, modification time and a hash of the first bytes (the run header)
+    struct FileKey
+    {
+        uint64_t size;
+        int64_t time;
+        uint64_t hash;
+        
+        bool Read(const std::string& theFileName)
+        {
+            struct stat s;
+            if (stat(theFileName.c_str(), &s)) return false;
+            FILE* f = fopen(theFileName.c_str(), "rb");
+            if (!f) return false;
+            std::vector<char> buffer(kHashedBytes);
+            const size_t n = fread(&buffer[0], 1, buffer.size(), f);
+            fclose(f);
+            size = s.st_size;
+            time = s.st_mtime;
+            hash = Hash(&buffer[0], n);
+            return true;
+        }
+        bool operator==(const FileKey& other) const
+        { return size == other.size && time == other.time && hash == other.hash; }
+    };
+    
+    template <class T> bool Put(FILE* f, const T& value) { return fwrite(&value, sizeof(T), 1, f) == 1; }
+    template <class T> bool Get(FILE* f, T& value) { return fread(&value, sizeof(T), 1, f) == 1; }
+    
+    // vectors are written with 64 bit elements, whatever their type
+    template <class T> bool Put(FILE* f, const std::vector<T>& v)
+    {
+        bool ok = Put(f, uint64_t(v.size()));
+        for (size_t i = 0; ok && i != v.size(); ++i) ok = Put(f, int64_t(v[i]));
+        return ok;
+    }
+    template <class T> bool Get(FILE* f, std::vector<T>& v)
+    {
+        uint64_t n;
+        int64_t value;
+        if (!Get(f, n)) return false;
+        for (uint64_t i = 0; i != n; ++i)
+        {
+            if (!Get(f, value)) return false;
+            v.push_back(T(value));
+        }
+        return true;
+    }
+}
+
 std::string FileIndex::String()
 {
     std::ostringstream str;
     str << "file index" << std::endl;
+    for (size_t i = 0; i != runHeaders.size(); ++i)
+    {
+        str << "run " << runNumbers[i] << ", header " << runHeaders[i];
+        if (i < runTrailers.size())
+            str << ", trailer " << runTrailers[i];
+        str << std::endl;
+    }
     for (size_t i = 0; i != eventHeaders.size(); ++i)
     {
-        str << i << ", header " << eventHeaders[i] << ", trailer " << eventTrailers[i];
+        str << i << ", header " << eventHeaders[i];
+        if (i < eventTrailers.size())
+            str << ", trailer " << eventTrailers[i];
         if (longBlocks.size())
             str << ", long " << longBlocks[i];
         str<< std::endl;
@@ -17,84 +101,316 @@ std::string FileIndex::String()
     return str.str();
 }
 
+void FileIndex::AddRun(size_t thePosition, int theRunNumber)
+{
+    if (runHeaders.empty())
+        runNumber = theRunNumber;
+    runHeaders.push_back(thePosition);
+    runNumbers.push_back(theRunNumber);
+}
 
+void FileIndex::AddEvent(size_t thePosition, unsigned int theEventNumber)
+{
+    const unsigned int run = runHeaders.empty() ? 0 : runHeaders.size() - 1;
+    const int number = runNumbers.empty() ? runNumber : runNumbers[run];
+    IDToPosition.insert(std::make_pair(theEventNumber, (unsigned int)eventHeaders.size()));
+    RunEventToPosition[std::make_pair(number, theEventNumber)] = eventHeaders.size();
+    eventHeaders.push_back(thePosition);
+    eventNumbers.push_back(theEventNumber);
+    eventRuns.push_back(run);
+}
 
-template <class Thinning> void Scan(FileIndex& index, RawStream& stream, bool force)
+// Whether every run that was started has ended. Set when the end of the file is reached
+static bool RunsClosed(const FileIndex& index)
 {
-    if (!force && !stream.IsSeekable()) return;
-    
-    size_t startingBlockNumber = stream.GetNextPosition();
-    if (stream.IsSeekable())
-        stream.SeekTo(0);
-    
-    unsigned int eventsSoFar = 0;
-    
-    size_t blockIndex = 0;
-    bool foundEventHeader = false;
-    bool foundRunHeader = false;
-    bool foundLongBlock = false;
-    
-    Block<Thinning> blockUnth;
-    while (stream.GetNextBlock(blockUnth) && !blockUnth.IsRunTrailer())
+    return !index.runTrailers.empty() && index.runTrailers.size() == index.runHeaders.size();
+}
+
+
+// Enter one block into the index. Returns false where scanning stops: when no event turned up
+// in the first 400 blocks. Run trailers do not stop it, another run can follow (concatenated files)
+static bool AddBlock(FileIndex& index, size_t position, const BlockID& id, float word, bool& foundRunHeader)
+{
+    index.scannedBlocks = position + 1;
+    if (id == "RUNE")
     {
-        ++blockIndex;
-        if (blockUnth.IsEventHeader())
-        {
-            foundEventHeader = true;
-            foundLongBlock = false;
-            size_t rawPosition = stream.GetNextPosition();
-            index.eventHeaders.push_back(rawPosition - 1);
-            index.IDToPosition[int(blockUnth.AsEventHeader.fEventNumber)] = eventsSoFar;
-            ++eventsSoFar;
-        }
-        else if (blockUnth.IsEventTrailer())
-        {
-            index.eventTrailers.push_back(stream.GetNextPosition() - 1);
-        }
-        else if (blockUnth.IsRunHeader())
-        {
-            foundRunHeader = true;
-            index.runNumber = int(blockUnth.AsRunHeader.fRunNumber);
-        }
-        else if (!foundLongBlock && blockUnth.IsLongitudinal())
-        {
-            foundLongBlock = true;
-            index.longBlocks.push_back(stream.GetNextPosition() - 1);
-        }
-        if (blockIndex >400 && !foundRunHeader)
-            throw IOException("Error scanning Corsika ground file: could not find run header");
-        
-        if (blockIndex >400 && !foundEventHeader) break;
+        index.runTrailers.push_back(position);
+    }
+    else if (id == "EVTH")
+    {
+        index.AddEvent(position, (unsigned int)word);
+    }
+    else if (id == "EVTE")
+    {
+        index.eventTrailers.push_back(position);
     }
+    else if (id == "RUNH")
+    {
+        foundRunHeader = true;
+        index.AddRun(position, int(word));
+    }
+    else if (id == "LONG" && index.longBlocks.size() < index.eventHeaders.size())
+    {
+        index.longBlocks.push_back(position);
+    }
+    if (index.scannedBlocks > 400 && !foundRunHeader)
+        throw IOException("Error scanning Corsika ground file: could not find run header");
     
-    if (!blockUnth.IsRunTrailer())
+    return index.scannedBlocks <= 400 || !index.eventHeaders.empty();
+}
+
+static void CheckIndex(const FileIndex& index, bool foundAll)
+{
+    if (!index.complete && !foundAll)
     {
         std::ostringstream msg;
         msg << "Error scanning Corsika ground file: could not find run end.";
-        if (foundEventHeader)
-            msg << std::endl << "Found " << eventsSoFar << " event headers.";
+        if (!index.eventHeaders.empty())
+            msg << std::endl << "Found " << index.eventHeaders.size() << " event headers.";
         
         throw IOException(msg.str());
     }
     
-    if (index.eventHeaders.size() != index.eventTrailers.size())
+    if (index.complete && index.eventHeaders.size() != index.eventTrailers.size())
         throw IOException("Found different number of event-headers and -trailers");
     
-    if (index.longBlocks.size() > 0 && index.eventHeaders.size() != index.longBlocks.size())
+    if (index.complete && index.longBlocks.size() > 0 && index.eventHeaders.size() != index.longBlocks.size())
     {
         std::ostringstream msg;
         msg << "Found different number of event-headers and longitudinal blocks ("
         << index.eventHeaders.size() << " != " << index.longBlocks.size() << ")";
         throw IOException(msg.str());
     }
+}
+
+template <class Thinning, class Found> bool ScanEvents(FileIndex& index, RawStream& stream, Found found)
+{
+    if (index.complete || found())
+        return found();
+    
+    size_t startingBlockNumber = stream.GetNextPosition();
+    if (stream.IsSeekable())
+        stream.SeekTo(index.scannedBlocks);
+    
+    bool foundRunHeader = index.scannedBlocks > 0;
+    
+    const Block<Thinning>* block = 0;
+    while (!found())
+    {
+        if (!stream.GetNextBlockView(block))
+        {
+            index.complete = RunsClosed(index);
+            break;
+        }
+        const RunHeader& header = block->AsRunHeader;
+        if (!AddBlock(index, stream.GetNextPosition() - 1, header.fID, header.fRunNumber, foundRunHeader))
+            break;
+    }
+    const bool foundAll = found();
+    CheckIndex(index, foundAll);
     
     if (stream.IsSeekable())
         stream.SeekTo(startingBlockNumber);
+    return foundAll;
+}
+
+typedef std::vector<std::pair<size_t, RawStream::BlockInfo> > BlockList;
+
+// Control and longitudinal blocks in [first, last)
+static bool FindBlocks(const RawStream& stream, size_t first, size_t last, BlockList& found)
+{
+    const size_t kChunk = 64 * kSubBlocksPerBlock;
+    std::vector<RawStream::BlockInfo> info(kChunk);
+    while (first < last)
+    {
+        const size_t n = stream.GetBlockIDs(first, std::min(kChunk, last - first), &info[0]);
+        if (!n) return false;
+        for (size_t i = 0; i != n; ++i)
+        {
+            const BlockID& id = info[i].fID;
+            if (id == "RUNH" || id == "EVTH" || id == "EVTE" || id == "LONG" || id == "RUNE")
+                found.push_back(std::make_pair(first + i, info[i]));
+        }
+        first += n;
+    }
+    return true;
+}
+
+void FileIndex::Clear()
+{
+    runNumber = 0;
+    runHeaders.clear();
+    runTrailers.clear();
+    runNumbers.clear();
+    eventHeaders.clear();
+    eventTrailers.clear();
+    longBlocks.clear();
+    eventNumbers.clear();
+    eventRuns.clear();
+    IDToPosition.clear();
+    RunEventToPosition.clear();
+    complete = false;
+    scannedBlocks = 0;
 }
 
 void FileIndex::Scan(RawStream& stream, bool force)
 {
-    if (stream.IsThinned()) ::Scan<Thinned>(*this, stream, force);
-    else ::Scan<NotThinned>(*this, stream, force);
+    Clear();
+    if (!force && !stream.IsSeekable()) return;
+    if (!stream.IsSeekable()) scannedBlocks = stream.GetNextPosition();
+    ScanEvents(stream, size_t(-1));
 }
 
+bool FileIndex::ScanEvents(RawStream& stream, size_t nEvents)
+{
+    auto found = [this, nEvents]() { return eventTrailers.size() >= nEvents; };
+    if (stream.IsThinned()) return ::ScanEvents<Thinned>(*this, stream, found);
+    return ::ScanEvents<NotThinned>(*this, stream, found);
+}
+
+bool FileIndex::ScanUntil(RawStream& stream, const std::function<bool()>& theFound)
+{
+    if (stream.IsThinned()) return ::ScanEvents<Thinned>(*this, stream, theFound);
+    return ::ScanEvents<NotThinned>(*this, stream, theFound);
+}
+
+bool FileIndex::ScanBlockIDs(const RawStream& stream, unsigned int threads)
+{
+    const size_t nBlocks = stream.GetNBlocks();
+    if (!nBlocks) return false;
+    
+    // ranges of whole disk blocks, one per thread
+    threads = std::max(1u, threads);
+    const size_t nDiskBlocks = nBlocks / kSubBlocksPerBlock;
+    const size_t perThread = (nDiskBlocks + threads - 1) / threads * kSubBlocksPerBlock;
+    std::vector<BlockList> found(threads);
+    std::vector<std::future<bool> > tasks;
+    for (unsigned int t = 0; t != threads; ++t)
+    {
+        const size_t first = std::min(nBlocks, t * perThread);
+        const size_t last = std::min(nBlocks, first + perThread);
+        tasks.push_back(std::async(t ? std::launch::async : std::launch::deferred,
+                                   FindBlocks, std::cref(stream), first, last, std::ref(found[t])));
+    }
+    bool ok = true;
+    for (unsigned int t = 0; t != threads; ++t)
+        ok = tasks[t].get() && ok;
+    if (!ok) return false;
+    
+    Clear();
+    bool foundRunHeader = false;
+    bool more = true;
+    for (unsigned int t = 0; more && t != threads; ++t)
+    {
+        for (size_t i = 0; more && i != found[t].size(); ++i)
+            more = AddBlock(*this, found[t][i].first, found[t][i].second.fID, found[t][i].second.fWord, foundRunHeader);
+    }
+    complete = more && RunsClosed(*this);
+    CheckIndex(*this, false);
+    return true;
+}
+
+bool FileIndex::Save(const std::string& theIndexFile, const std::string& theDataFile) const
+{
+    FileKey key;
+    if (!complete || theIndexFile.empty() || !key.Read(theDataFile)) return false;
+    
+    const std::string tmp = theIndexFile + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(kIndexMagic, 1, 8, f) == 8 && Put(f, key) && Put(f, int32_t(runNumber)) &&
+        Put(f, runHeaders) && Put(f, runTrailers) && Put(f, runNumbers) &&
+        Put(f, eventHeaders) && Put(f, eventTrailers) && Put(f, longBlocks) && Put(f, eventNumbers) && Put(f, eventRuns);
+    ok = fclose(f) == 0 && ok;
+    if (ok) ok = rename(tmp.c_str(), theIndexFile.c_str()) == 0;
+    if (!ok) remove(tmp.c_str());
+    return ok;
+}
+
+static bool Increasing(const std::vector<size_t>& positions)
+{
+    for (size_t i = 1; i < positions.size(); ++i)
+        if (positions[i] <= positions[i - 1]) return false;
+    return true;
+}
+
+// Each header before its trailer
+static bool Ordered(const std::vector<size_t>& headers, const std::vector<size_t>& trailers)
+{
+    for (size_t i = 0; i != headers.size(); ++i)
+        if (trailers[i] <= headers[i]) return false;
+    return true;
+}
+
+bool FileIndex::Load(const std::string& theIndexFile, const std::string& theDataFile)
+{
+    FileKey current;
+    if (theIndexFile.empty() || !current.Read(theDataFile)) return false;
+    FILE* f = fopen(theIndexFile.c_str(), "rb");
+    if (!f) return false;
+    
+    FileIndex index;
+    char magic[8];
+    FileKey key;
+    int32_t run;
+    std::vector<size_t> eventPositions;
+    bool ok = fread(magic, 1, 8, f) == 8 && !memcmp(magic, kIndexMagic, 8) && Get(f, key) && key == current &&
+        Get(f, run) && Get(f, index.runHeaders) && Get(f, index.runTrailers) && Get(f, index.runNumbers) &&
+        Get(f, eventPositions) && Get(f, index.eventTrailers) && Get(f, index.longBlocks) &&
+        Get(f, index.eventNumbers) && Get(f, index.eventRuns);
+    fclose(f);
+    // the same checks as for a scanned index, a stale or truncated file is scanned again
+    ok = ok && index.runNumbers.size() == index.runHeaders.size() && index.runTrailers.size() == index.runHeaders.size() &&
+        index.eventNumbers.size() == eventPositions.size() && index.eventRuns.size() == eventPositions.size() &&
+        index.eventTrailers.size() == eventPositions.size() &&
+        (index.longBlocks.empty() || index.longBlocks.size() == eventPositions.size());
+    ok = ok && Increasing(index.runHeaders) && Increasing(index.runTrailers) && Increasing(eventPositions) &&
+        Increasing(index.eventTrailers) && Increasing(index.longBlocks) &&
+        Ordered(index.runHeaders, index.runTrailers) && Ordered(eventPositions, index.eventTrailers);
+    for (size_t i = 0; ok && i != index.eventRuns.size(); ++i)
+        ok = index.eventRuns[i] < index.runNumbers.size();
+    if (!ok) return false;
+    
+    runNumber = run;
+    complete = true;
+    runHeaders.swap(index.runHeaders);
+    runTrailers.swap(index.runTrailers);
+    runNumbers.swap(index.runNumbers);
+    eventHeaders.swap(eventPositions);
+    eventTrailers.swap(index.eventTrailers);
+    longBlocks.swap(index.longBlocks);
+    eventNumbers.swap(index.eventNumbers);
+    eventRuns.swap(index.eventRuns);
+    // the lookup tables are rebuilt from the events
+    IDToPosition.clear();
+    RunEventToPosition.clear();
+    for (size_t i = 0; i != eventHeaders.size(); ++i)
+    {
+        IDToPosition.insert(std::make_pair(eventNumbers[i], (unsigned int)i));
+        RunEventToPosition[std::make_pair(runNumbers[eventRuns[i]], eventNumbers[i])] = i;
+    }
+    return true;
+}
+
+std::string FileIndex::CacheName(const std::string& theDataFile)
+{
+    const bfs::path data = bfs::absolute(theDataFile);
+    if (!access(data.parent_path().string().c_str(), W_OK))
+        return data.string() + ".idx";
+    
+    bfs::path dir;
+    if (const char* cache = getenv("XDG_CACHE_HOME"))
+        dir = cache;
+    else if (const char* home = getenv("HOME"))
+        dir = bfs::path(home) / ".cache";
+    else
+        return "";
+    dir /= "corsika";
+    boost::system::error_code error;
+    bfs::create_directories(dir, error);
+    
+    // files with the same name in different directories must not share an entry
+    std::ostringstream name;
+    name << data.filename().string() << "-" << std::hex << Hash(data.string().data(), data.string().size()) << ".idx";
+    return (dir / name.str()).string();
+}
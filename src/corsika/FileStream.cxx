@@ -1,9 +1,27 @@
 #include <corsika/FileStream.h>
+#include "FileAdvice.h"
 #include <stdio.h>
 #include <string.h>
 #include <zlib.h>
 #include <bzlib.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using corsika::detail::fadvice;
+
+static int madvice(FileStream::Advice advice)
+{
+    const int map[] = {MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED, MADV_DONTNEED};
+    return map[advice];
+}
 
 struct RawFileStream: FileStream
 {
@@ -21,6 +39,92 @@ struct RawFileStream: FileStream
     {
         return fseek(file, absolute_position, SEEK_SET) == 0;
     }
+    long read_at(size_t absolute_position, size_t num, void* bytes)
+    {
+        if (!seekable) return -1;
+        size_t total = 0;
+        while (total < num)
+        {
+            ssize_t n = pread(fileno(file), (char*)bytes + total, num - total, absolute_position + total);
+            if (n <= 0) break;
+            total += n;
+        }
+        return total;
+    }
+    size_t size() const
+    {
+        struct stat s;
+        return seekable && !fstat(fileno(file), &s) && S_ISREG(s.st_mode) ? s.st_size : 0;
+    }
+    bool advise(Advice advice, size_t offset, size_t length)
+    {
+        return posix_fadvise(fileno(file), offset, length, fadvice(advice)) == 0;
+    }
+};
+// Bytes in memory, e.g. a mapped file or a buffer handed to open_memory
+struct MemoryFileStream: FileStream
+{
+    const char* data;
+    size_t length;
+    size_t position;
+    boost::shared_ptr<const void> owner;
+    MemoryFileStream(const void* data, size_t length, const boost::shared_ptr<const void>& owner):
+    FileStream(true), data((const char*)data), length(length), position(0), owner(owner) {}
+    long read(size_t num, void* bytes)
+    {
+        if (num > length - position) num = length - position;
+        memcpy(bytes, data + position, num);
+        position += num;
+        return num;
+    }
+    bool seek(size_t absolute_position)
+    {
+        if (absolute_position > length) return false;
+        position = absolute_position;
+        return true;
+    }
+    const void* view(size_t num)
+    {
+        if (num > length - position) return 0;
+        const char* p = data + position;
+        position += num;
+        return p;
+    }
+    long read_at(size_t absolute_position, size_t num, void* bytes)
+    {
+        if (absolute_position > length) return 0;
+        if (num > length - absolute_position) num = length - absolute_position;
+        memcpy(bytes, data + absolute_position, num);
+        return num;
+    }
+    const void* view_at(size_t absolute_position, size_t num)
+    {
+        if (absolute_position > length || num > length - absolute_position) return 0;
+        return data + absolute_position;
+    }
+    size_t size() const { return length; }
+};
+// A mapped file. The descriptor is kept to drop pages from the page cache, unmapping them only frees the mapping
+struct MmapFileStream: MemoryFileStream
+{
+    int fd;
+    MmapFileStream(const void* map, size_t length, int fd): MemoryFileStream(map, length, boost::shared_ptr<const void>()), fd(fd) {}
+    ~MmapFileStream()
+    {
+        munmap((void*)data, length);
+        close(fd);
+    }
+    bool advise(Advice advice, size_t offset, size_t length)
+    {
+        if (offset > this->length) return false;
+        if (!length || length > this->length - offset) length = this->length - offset;
+        // madvise wants page aligned addresses
+        const size_t page = sysconf(_SC_PAGESIZE);
+        const size_t begin = offset / page * page;
+        const bool ok = madvise((void*)(data + begin), offset + length - begin, madvice(advice)) == 0;
+        if (advice == kDontNeed) return posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED) == 0 && ok;
+        return ok;
+    }
 };
 struct GzFileStream: FileStream
 {
@@ -57,6 +161,124 @@ struct Bz2FileStream: FileStream
     }
 };
 
+// Reads chunks of another stream in a background thread, keeping up to depth of them ready
+struct ReadAheadFileStream: FileStream
+{
+    static const size_t kChunkSize = 1 << 20;
+    FileStream* source;
+    size_t depth;
+    std::deque<std::vector<char> > ready;
+    std::vector<char> chunk; // the one being consumed
+    size_t offset;           // in chunk
+    bool done;               // the source is exhausted
+    long status;             // result of the last read from the source once done
+    bool stop;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::thread thread;
+    
+    ReadAheadFileStream(FileStream* source, size_t depth): FileStream(source->seekable), source(source), depth(depth), offset(0)
+    {
+        start();
+    }
+    ~ReadAheadFileStream()
+    {
+        halt();
+        delete source;
+    }
+    void start()
+    {
+        done = false;
+        status = 0;
+        stop = false;
+        thread = std::thread(&ReadAheadFileStream::fill, this);
+    }
+    void halt()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cond.notify_all();
+        thread.join();
+    }
+    void fill()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            cond.wait(lock, [this] { return stop || ready.size() < depth; });
+            if (stop) return;
+            lock.unlock();
+            std::vector<char> next(kChunkSize);
+            long n = source->read(next.size(), &next[0]);
+            lock.lock();
+            if (n <= 0)
+            {
+                done = true;
+                status = n;
+                cond.notify_all();
+                return;
+            }
+            next.resize(n);
+            ready.push_back(std::move(next));
+            cond.notify_all();
+        }
+    }
+    bool next_chunk()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this] { return done || !ready.empty(); });
+        if (ready.empty()) return false;
+        chunk.swap(ready.front());
+        ready.pop_front();
+        offset = 0;
+        cond.notify_all();
+        return true;
+    }
+    long read(size_t num, void* bytes)
+    {
+        size_t total = 0;
+        while (total < num)
+        {
+            if (offset == chunk.size() && !next_chunk())
+                return total ? long(total) : status;
+            size_t n = std::min(num - total, chunk.size() - offset);
+            memcpy((char*)bytes + total, &chunk[offset], n);
+            offset += n;
+            total += n;
+        }
+        return total;
+    }
+    bool seek(size_t absolute_position)
+    {
+        halt();
+        ready.clear();
+        chunk.clear();
+        offset = 0;
+        bool ok = source->seek(absolute_position);
+        start();
+        return ok;
+    }
+    long read_at(size_t absolute_position, size_t num, void* bytes)
+    {
+        return source->read_at(absolute_position, num, bytes);
+    }
+    size_t size() const { return source->size(); }
+    bool advise(Advice advice, size_t offset, size_t length)
+    {
+        return source->advise(advice, offset, length);
+    }
+    const void* view(size_t num)
+    {
+        if (offset == chunk.size() && !next_chunk()) return 0;
+        if (num > chunk.size() - offset) return 0;
+        const char* p = &chunk[offset];
+        offset += num;
+        return p;
+    }
+};
+
 static bool ends_with(const char* string, const char* postfix)
 {
     size_t l0 = strlen(string);
@@ -65,25 +287,139 @@ static bool ends_with(const char* string, const char* postfix)
     return false;
 }
 
-FileStream* FileStream::open(const char* filename)
+FileStream* open_parallel_bz2(const char* filename, unsigned int threads);
+FileStream* open_indexed_gz(const char* filename, const struct stat& s, size_t span, bool persistent);
+FileStream* open_xz(const char* filename);
+FileStream* open_zstd(const char* filename, bool seekable);
+FileStream* open_tar_member(const char* archive, const char* member, const FileStream::Options& options);
+FileStream* open_async(const char* filename, size_t depth);
+
+static bool has_magic(const FileStream::Probe& probe, const char* magic, size_t size, const char* suffix)
+{
+    if (!probe.magic_size) return ends_with(probe.filename, suffix);
+    return probe.magic_size >= size && memcmp(probe.magic, magic, size) == 0;
+}
+
+static FileStream* gz_factory(const FileStream::Probe& probe, const FileStream::Options& options)
 {
+    if (!has_magic(probe, "\x1f\x8b", 2, ".gz")) return 0;
+    struct stat s;
+    if (probe.seekable && options.gz_index_span && !stat(probe.filename, &s))
+        return open_indexed_gz(probe.filename, s, options.gz_index_span, options.gz_index_file);
+    if (gzFile f = gzopen(probe.filename, "r"))
+        return new GzFileStream(f, probe.seekable);
+    return 0;
+}
+
+static FileStream* bz2_factory(const FileStream::Probe& probe, const FileStream::Options& options)
+{
+    if (!has_magic(probe, "BZh", 3, ".bz2")) return 0;
+    if (options.threads > 1)
+        return open_parallel_bz2(probe.filename, options.threads);
+    if (BZFILE* f = BZ2_bzopen(probe.filename, "r"))
+        return new Bz2FileStream(f);
+    return 0;
+}
+
+static FileStream* xz_factory(const FileStream::Probe& probe, const FileStream::Options& options)
+{
+    if (!has_magic(probe, "\xfd" "7zXZ\0", 6, ".xz")) return 0;
+    return open_xz(probe.filename);
+}
+
+static FileStream* zstd_factory(const FileStream::Probe& probe, const FileStream::Options& options)
+{
+    // a frame, or a skippable frame (0x184D2A50 to 0x184D2A5F)
+    const bool skippable = probe.magic_size >= 4 && (probe.magic[0] & 0xf0) == 0x50 && !memcmp(probe.magic + 1, "\x2a\x4d\x18", 3);
+    if (!skippable && !has_magic(probe, "\x28\xb5\x2f\xfd", 4, ".zst")) return 0;
+    return open_zstd(probe.filename, probe.seekable);
+}
+
+static std::mutex registry_mutex;
+static std::vector<FileStream::Factory>& registry()
+{
+    static std::vector<FileStream::Factory> factories;
+    return factories;
+}
+
+void FileStream::register_factory(Factory factory)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry().push_back(factory);
+}
+
+FileStream* FileStream::open(const char* filename, const Options& options)
+{
+    if (!strcmp(filename, "-"))
+    {
+        FILE* f = fdopen(dup(0), "rb");
+        if (!f) return 0;
+        FileStream* file = new RawFileStream(f, false);
+        if (options.read_ahead) return new ReadAheadFileStream(file, options.read_ahead);
+        return file;
+    }
+    
+    std::string archive, member;
+    if (archive_member(filename, archive, member))
+    {
+        Options archive_options = options;
+        archive_options.read_ahead = 0;
+        FileStream* file = open_tar_member(archive.c_str(), member.c_str(), archive_options);
+        if (file && options.read_ahead) return new ReadAheadFileStream(file, options.read_ahead);
+        return file;
+    }
+    
     struct stat s;
     if (stat(filename, &s)) return 0; // failed to stat file
-    bool seekable = !S_ISFIFO(s.st_mode) && !S_ISSOCK(s.st_mode);
-    if (ends_with(filename, ".gz"))
+    
+    // Formats are recognized by their first bytes. Those of pipes can not be read twice, the suffix is used then
+    unsigned char magic[kMagicSize];
+    Probe probe = {filename, magic, 0, !S_ISFIFO(s.st_mode) && !S_ISSOCK(s.st_mode)};
+    if (S_ISREG(s.st_mode))
     {
-        if (gzFile f = gzopen(filename, "r"))
-            return new GzFileStream(f, seekable);
+        FILE* f = fopen(filename, "rb");
+        if (!f) return 0;
+        probe.magic_size = fread(magic, 1, kMagicSize, f);
+        fclose(f);
     }
-    else if (ends_with(filename, ".bz2"))
+    
+    std::vector<Factory> factories;
     {
-        if (BZFILE* f = BZ2_bzopen(filename, "r"))
-            return new Bz2FileStream(f);
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        factories.assign(registry().rbegin(), registry().rend());
     }
-    else
+    const Factory builtin[] = {gz_factory, bz2_factory, xz_factory, zstd_factory};
+    factories.insert(factories.end(), builtin, builtin + sizeof(builtin) / sizeof(builtin[0]));
+    
+    FileStream* file = 0;
+    for (size_t i = 0; i != factories.size() && !file; ++i)
+        file = factories[i](probe, options);
+    
+    if (!file)
     {
-        if (FILE* f = fopen(filename, "rb"))
-            return new RawFileStream(f, seekable);
+        // Plain files are mapped, unless asked for asynchronous reads. If that fails (e.g. no address space left), fall back to stdio
+        if (S_ISREG(s.st_mode) && s.st_size > 0 && options.queue_depth)
+            file = open_async(filename, options.queue_depth);
+        if (!file && S_ISREG(s.st_mode) && s.st_size > 0)
+        {
+            const int fd = ::open(filename, O_RDONLY);
+            if (fd >= 0)
+            {
+                void* map = mmap(0, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (map != MAP_FAILED) return new MmapFileStream(map, s.st_size, fd);
+                close(fd);
+            }
+        }
+        if (!file)
+            if (FILE* f = fopen(filename, "rb"))
+                file = new RawFileStream(f, probe.seekable);
     }
-    return 0;
+    if (file && options.read_ahead) return new ReadAheadFileStream(file, options.read_ahead);
+    return file;
+}
+
+FileStream* FileStream::open_memory(const void* data, size_t size, const boost::shared_ptr<const void>& owner)
+{
+    if (!data && size) return 0;
+    return new MemoryFileStream(data, size, owner);
 }
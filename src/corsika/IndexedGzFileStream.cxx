@@ -0,0 +1,317 @@
+/**
+ \file
+ Random access into gzip compressed files
+
+ gzseek can only go forward. Going back means inflating again from the
+ start of the file. This reader records access points while it inflates:
+ the compressed position of a deflate block boundary together with the
+ 32 kB of output preceding it, which is all inflate needs to resume
+ there. Seeking then costs at most one span of inflation. The index can
+ be stored next to the file (name.gzidx) and reused by later readers.
+
+ The technique is the one of zran.c in the zlib distribution.
+ */
+#include <corsika/FileStream.h>
+#include <zlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const size_t kWindowSize = 32768;
+    const size_t kInputSize = 1 << 16;
+    const char kIndexMagic[8] = {'C', 'R', 'G', 'Z', 'I', 'D', 'X', '1'};
+
+    struct AccessPoint
+    {
+        uint64_t out;  // uncompressed offset
+        uint64_t in;   // compressed offset of the first full byte
+        int bits;      // bits of the byte before `in` still to be used
+        std::vector<unsigned char> window; // uncompressed data preceding `out`
+    };
+
+    template <class T> bool put(FILE* f, const T& value) { return fwrite(&value, sizeof(T), 1, f) == 1; }
+    template <class T> bool get(FILE* f, T& value) { return fread(&value, sizeof(T), 1, f) == 1; }
+}
+
+struct IndexedGzFileStream: FileStream
+{
+    FILE* file;
+    std::string index_file; // empty if the index is not persisted
+    uint64_t file_size;
+    int64_t file_time;
+    size_t span;
+    std::vector<AccessPoint> points;
+    bool index_changed;
+
+    z_stream z;
+    std::vector<unsigned char> input;
+    uint64_t input_end;      // compressed offset just after the data in `input`
+    bool input_eof;
+    std::vector<unsigned char> window;
+    size_t window_pos;       // inflate writes here next
+    size_t available;        // bytes before window_pos not handed out yet
+    uint64_t produced;       // uncompressed offset of window_pos
+    bool raw;                // inflating a raw deflate stream after jumping to an access point
+    bool in_member;          // a gzip member has been started but not finished
+    bool finished;
+    long status;
+
+    IndexedGzFileStream(FILE* file, const struct stat& s, size_t span, const std::string& index_file):
+    FileStream(true), file(file), index_file(index_file), file_size(s.st_size), file_time(s.st_mtime), span(std::max(span, kWindowSize)),
+    index_changed(false), input(kInputSize), window(kWindowSize)
+    {
+        memset(&z, 0, sizeof(z));
+        inflateInit2(&z, 15 + 32);
+        if (!index_file.empty()) load();
+        rewind();
+    }
+    ~IndexedGzFileStream()
+    {
+        if (index_changed && !index_file.empty()) save();
+        inflateEnd(&z);
+        fclose(file);
+    }
+
+    uint64_t position() const { return produced - available; }
+
+    void reset_output(uint64_t offset)
+    {
+        window_pos = 0;
+        available = 0;
+        produced = offset;
+        in_member = true;
+        finished = false;
+        status = 0;
+    }
+    bool rewind()
+    {
+        if (fseeko(file, 0, SEEK_SET)) return false;
+        input_end = 0;
+        input_eof = false;
+        z.avail_in = 0;
+        raw = false;
+        inflateReset2(&z, 15 + 32);
+        reset_output(0);
+        return true;
+    }
+    bool restore(const AccessPoint& point)
+    {
+        if (fseeko(file, point.in - (point.bits ? 1 : 0), SEEK_SET)) return false;
+        input_end = point.in - (point.bits ? 1 : 0);
+        input_eof = false;
+        z.avail_in = 0;
+        raw = true;
+        inflateReset2(&z, -15);
+        if (point.bits)
+        {
+            int c = fgetc(file);
+            if (c == EOF) return false;
+            ++input_end;
+            inflatePrime(&z, point.bits, c >> (8 - point.bits));
+        }
+        inflateSetDictionary(&z, &point.window[0], kWindowSize);
+        reset_output(point.out);
+        // later access points need the data preceding them
+        memcpy(&window[0], &point.window[0], kWindowSize);
+        window_pos = kWindowSize;
+        return true;
+    }
+
+    bool fill_input()
+    {
+        if (input_eof) return false;
+        size_t n = fread(&input[0], 1, input.size(), file);
+        if (!n)
+        {
+            input_eof = true;
+            return false;
+        }
+        input_end += n;
+        z.next_in = &input[0];
+        z.avail_in = n;
+        return true;
+    }
+    bool skip_input(size_t n)
+    {
+        while (n)
+        {
+            if (!z.avail_in && !fill_input()) return false;
+            size_t k = std::min<size_t>(n, z.avail_in);
+            z.next_in += k;
+            z.avail_in -= k;
+            n -= k;
+        }
+        return true;
+    }
+
+    void add_point()
+    {
+        AccessPoint point;
+        point.out = produced;
+        point.in = input_end - z.avail_in;
+        point.bits = z.data_type & 7;
+        point.window.resize(kWindowSize);
+        memcpy(&point.window[0], &window[window_pos], kWindowSize - window_pos);
+        memcpy(&point.window[kWindowSize - window_pos], &window[0], window_pos);
+        points.push_back(point);
+        index_changed = true;
+    }
+
+    // Inflate more data into the window. False at the end of the data or on errors (then status < 0)
+    bool produce()
+    {
+        if (finished) return false;
+        if (window_pos == kWindowSize) window_pos = 0;
+        while (window_pos < kWindowSize)
+        {
+            if (!z.avail_in && !fill_input())
+            {
+                finished = true;
+                if (in_member) status = -1; // truncated
+                break;
+            }
+            z.next_out = &window[window_pos];
+            z.avail_out = kWindowSize - window_pos;
+            int ret = inflate(&z, Z_BLOCK);
+            const size_t n = kWindowSize - window_pos - z.avail_out;
+            window_pos += n;
+            available += n;
+            produced += n;
+            if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR)
+            {
+                finished = true;
+                status = -1;
+                break;
+            }
+            if (ret == Z_STREAM_END)
+            {
+                // the gzip trailer is left over when inflating raw deflate data
+                if (raw && !skip_input(8))
+                {
+                    finished = true;
+                    status = -1;
+                    break;
+                }
+                // another member may follow
+                raw = false;
+                in_member = false;
+                inflateReset2(&z, 15 + 32);
+                if (!z.avail_in && !fill_input())
+                {
+                    finished = true;
+                    break;
+                }
+                in_member = true;
+                continue;
+            }
+            if ((z.data_type & 128) && !(z.data_type & 64) && produced >= kWindowSize &&
+                produced >= (points.empty() ? 0 : points.back().out) + span)
+                add_point();
+            if (n) return true;
+        }
+        return available > 0;
+    }
+
+    long read(size_t num, void* bytes)
+    {
+        size_t total = 0;
+        while (total < num)
+        {
+            if (!available && !produce())
+                return total ? long(total) : status;
+            const size_t n = std::min(num - total, available);
+            memcpy((char*)bytes + total, &window[window_pos - available], n);
+            available -= n;
+            total += n;
+        }
+        return total;
+    }
+    bool seek(size_t absolute_position)
+    {
+        const uint64_t target = absolute_position;
+        // last access point at or before the target
+        size_t first = 0, count = points.size();
+        while (count)
+        {
+            const size_t half = count / 2;
+            if (points[first + half].out <= target)
+            {
+                first += half + 1;
+                count -= half + 1;
+            }
+            else count = half;
+        }
+        const AccessPoint* point = first ? &points[first - 1] : 0;
+
+        if (target < position() || (point && point->out > position()))
+        {
+            if (!(point ? restore(*point) : rewind())) return false;
+        }
+        while (position() < target)
+        {
+            if (!available && !produce()) return false;
+            available -= std::min<uint64_t>(available, target - position());
+        }
+        return true;
+    }
+
+    bool load()
+    {
+        FILE* f = fopen(index_file.c_str(), "rb");
+        if (!f) return false;
+        char magic[8];
+        uint64_t size, count, length;
+        int64_t time;
+        bool ok = fread(magic, 1, 8, f) == 8 && !memcmp(magic, kIndexMagic, 8) &&
+            get(f, size) && get(f, time) && get(f, count) && size == file_size && time == file_time;
+        std::vector<unsigned char> packed;
+        for (uint64_t i = 0; ok && i != count; ++i)
+        {
+            AccessPoint point;
+            int32_t bits;
+            ok = get(f, point.out) && get(f, point.in) && get(f, bits) && get(f, length) && length < 2 * kWindowSize;
+            if (!ok) break;
+            point.bits = bits;
+            packed.resize(length);
+            point.window.resize(kWindowSize);
+            uLongf unpacked = kWindowSize;
+            ok = fread(&packed[0], 1, length, f) == length &&
+                uncompress(&point.window[0], &unpacked, &packed[0], length) == Z_OK && unpacked == kWindowSize;
+            if (ok) points.push_back(point);
+        }
+        fclose(f);
+        if (!ok) points.clear();
+        return ok;
+    }
+    void save()
+    {
+        const std::string tmp = index_file + ".tmp";
+        FILE* f = fopen(tmp.c_str(), "wb");
+        if (!f) return;
+        bool ok = fwrite(kIndexMagic, 1, 8, f) == 8 && put(f, file_size) && put(f, file_time) && put(f, uint64_t(points.size()));
+        std::vector<unsigned char> packed(compressBound(kWindowSize));
+        for (size_t i = 0; ok && i != points.size(); ++i)
+        {
+            uLongf length = packed.size();
+            ok = compress(&packed[0], &length, &points[i].window[0], kWindowSize) == Z_OK &&
+                put(f, points[i].out) && put(f, points[i].in) && put(f, int32_t(points[i].bits)) && put(f, uint64_t(length)) &&
+                fwrite(&packed[0], 1, length, f) == length;
+        }
+        ok = fclose(f) == 0 && ok;
+        if (ok) ok = rename(tmp.c_str(), index_file.c_str()) == 0;
+        if (!ok) remove(tmp.c_str());
+    }
+};
+
+FileStream* open_indexed_gz(const char* filename, const struct stat& s, size_t span, bool persistent)
+{
+    if (FILE* f = fopen(filename, "rb"))
+        return new IndexedGzFileStream(f, s, span, persistent ? std::string(filename) + ".gzidx" : std::string());
+    return 0;
+}
@@ -10,6 +10,7 @@
 #include <corsika/Constants.h>
 #include <corsika/LongFile.h>
 #include <corsika/IOException.h>
+#include <corsika/FileStream.h>
 
 #include <fstream>
 #include <sstream>
@@ -19,6 +20,7 @@
 #include <iostream>
 
 #include <boost/tokenizer.hpp>
+#include <boost/scoped_ptr.hpp>
 
 using namespace std;
 using namespace corsika;
@@ -66,8 +68,30 @@ LongFile::LongFile(string filename, double zenith):
     fDx(0.),
     fNBinsParticles(0),
     fNBinsEnergyDeposit(0),
-    fLongDataFile(new std::ifstream(fFilename.c_str()))
+    fIsOpen(false)
 {
+    std::string archive, member;
+    if (FileStream::archive_member(fFilename.c_str(), archive, member))
+    {
+        // members of archives are small text files, read them in one go
+        std::string contents;
+        boost::scoped_ptr<FileStream> file(FileStream::open(fFilename.c_str()));
+        if (file)
+        {
+            char buffer[1 << 16];
+            long n;
+            while ((n = file->read(sizeof(buffer), buffer)) > 0)
+                contents.append(buffer, n);
+        }
+        fIsOpen = bool(file);
+        fLongDataFile.reset(new std::istringstream(contents));
+    }
+    else
+    {
+        std::ifstream* file = new std::ifstream(fFilename.c_str());
+        fIsOpen = file->is_open();
+        fLongDataFile.reset(file);
+    }
     // check if file exists and is readable here
     Scan();
 }
@@ -95,7 +119,7 @@ void LongFile::Scan()
     //static const double deg = 3.14159/180;
     
     // Read CORSIKA profile if available
-    if (!fLongDataFile->is_open()) return;
+    if (!fIsOpen) return;
     
     string line;
     while (getline(*fLongDataFile.get(), line) && (fPartProfiles.size()==0 || fdEdXProfiles.size()==0))
@@ -188,7 +212,7 @@ LongProfile LongFile::FetchProfile(size_t findShower)
     double energyDepositSum = 0.;
     
     // Read CORSIKA profile if available
-    if (!fLongDataFile->is_open())
+    if (!fIsOpen)
     {
         ERROR("Reading failed for some reason.");
         return LongProfile();
@@ -0,0 +1,336 @@
+/**
+ \file
+ Multi-threaded reader for bzip2 compressed files
+
+ bzip2 compresses each block (at most 900 kB) independently. Blocks are
+ not byte aligned but start with a 48-bit magic number, so they can be
+ found by scanning the bit stream. Each one is wrapped into a single-block
+ bzip2 stream of its own and decompressed on a separate thread. The output
+ is handed to the reader in file order.
+
+ The block magic can also occur by chance inside compressed data. A block
+ that fails to decompress is therefore joined with the following one and
+ decoded again. The same goes for the end-of-stream magic: what follows it
+ is kept as a segment of its own, which is dropped as the trailer of a
+ stream (CRC and the header of the next stream) if the block before it
+ decodes.
+ */
+#include <corsika/FileStream.h>
+#include <bzlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <vector>
+
+namespace
+{
+    const uint64_t kBlockMagic = 0x314159265359ULL;
+    const uint64_t kEndMagic   = 0x177245385090ULL;
+    const uint64_t kMagicMask  = 0xFFFFFFFFFFFFULL;
+    const size_t kNoMagic = size_t(-1);
+    const size_t kInputChunk = 4 << 20;
+    const unsigned int kMaxJoins = 8;
+
+    inline unsigned int bit_at(const unsigned char* src, size_t pos)
+    {
+        return (src[pos >> 3] >> (7 - (pos & 7))) & 1;
+    }
+    inline unsigned char byte_at(const unsigned char* src, size_t pos)
+    {
+        const size_t b = pos >> 3;
+        const unsigned int s = pos & 7;
+        if (!s) return src[b];
+        return (unsigned char)((src[b] << s) | (src[b + 1] >> (8 - s)));
+    }
+
+    // Bit string, most significant bit first as bzip2 writes it
+    struct BitString
+    {
+        std::vector<unsigned char> bytes;
+        size_t bits;
+
+        BitString(): bits(0) {}
+        void put_byte(unsigned char v)
+        {
+            const unsigned int r = bits & 7;
+            if (!r) bytes.push_back(v);
+            else
+            {
+                bytes.back() |= v >> r;
+                bytes.push_back((unsigned char)(v << (8 - r)));
+            }
+            bits += 8;
+        }
+        void put_bit(unsigned int v)
+        {
+            if (!(bits & 7)) bytes.push_back(0);
+            if (v) bytes.back() |= 0x80 >> (bits & 7);
+            ++bits;
+        }
+        void put(uint64_t value, int n)
+        {
+            while (n >= 8) { n -= 8; put_byte((unsigned char)(value >> n)); }
+            while (n > 0) { --n; put_bit((value >> n) & 1); }
+        }
+        void append(const unsigned char* src, size_t first, size_t n)
+        {
+            const size_t end = first + n;
+            if (!(first & 7) && !(bits & 7))
+            {
+                bytes.insert(bytes.end(), src + first / 8, src + first / 8 + n / 8);
+                bits += n / 8 * 8;
+                first += n / 8 * 8;
+            }
+            for (; first + 8 <= end; first += 8) put_byte(byte_at(src, first));
+            for (; first < end; ++first) put_bit(bit_at(src, first));
+        }
+        void append(const BitString& other)
+        {
+            if (other.bits) append(&other.bytes[0], 0, other.bits);
+        }
+        uint32_t get32(size_t pos) const
+        {
+            uint32_t v = 0;
+            for (int i = 0; i != 4; ++i) v = (v << 8) | byte_at(&bytes[0], pos + 8 * i);
+            return v;
+        }
+    };
+
+    struct Decoded
+    {
+        bool ok;
+        std::vector<char> data;
+    };
+
+    // A segment starts with the block magic and runs up to the next magic
+    Decoded decode(const BitString& segment)
+    {
+        Decoded result;
+        result.ok = false;
+        if (segment.bits < 48 + 32) return result;
+
+        // header, the block, end of stream magic and the stream CRC, which for a single block is the block CRC
+        BitString stream;
+        stream.put_byte('B');
+        stream.put_byte('Z');
+        stream.put_byte('h');
+        stream.put_byte('9');
+        stream.append(segment);
+        stream.put(kEndMagic, 48);
+        stream.put(segment.get32(48), 32);
+
+        bz_stream z;
+        memset(&z, 0, sizeof(z));
+        if (BZ2_bzDecompressInit(&z, 0, 0) != BZ_OK) return result;
+        z.next_in = (char*)&stream.bytes[0];
+        z.avail_in = stream.bytes.size();
+
+        result.data.resize(1 << 20);
+        size_t produced = 0;
+        int status;
+        do
+        {
+            if (produced == result.data.size()) result.data.resize(2 * result.data.size());
+            z.next_out = &result.data[produced];
+            z.avail_out = result.data.size() - produced;
+            status = BZ2_bzDecompress(&z);
+            produced = result.data.size() - z.avail_out;
+        } while (status == BZ_OK && (z.avail_in || !z.avail_out));
+        BZ2_bzDecompressEnd(&z);
+
+        result.data.resize(produced);
+        result.ok = status == BZ_STREAM_END;
+        return result;
+    }
+
+    struct Task
+    {
+        BitString segment;
+        bool trailer; // starts with the end-of-stream magic
+        std::future<Decoded> result;
+    };
+}
+
+struct ParallelBz2FileStream: FileStream
+{
+    FILE* file;
+    unsigned int threads;
+
+    std::vector<unsigned char> in; // compressed input not consumed yet
+    bool input_done;
+    size_t scan;                   // bit in `in` where the search for the next magic continues
+    size_t start;                  // bit in `in` where the current segment starts, kNoMagic before the first block
+    bool start_end;                // the current segment starts with the end-of-stream magic
+    bool scan_done;
+
+    std::deque<Task> tasks;
+    std::vector<char> current;
+    size_t offset;
+    long status;
+
+    ParallelBz2FileStream(FILE* file, unsigned int threads):
+    FileStream(false), file(file), threads(threads), input_done(false), scan(0), start(kNoMagic), start_end(false), scan_done(false), offset(0), status(0)
+    {}
+    ~ParallelBz2FileStream()
+    {
+        tasks.clear(); // waits for pending decoding
+        fclose(file);
+    }
+
+    // Bit position of the next block or end-of-stream magic at or after bit `from`
+    size_t find_magic(size_t from, bool& end) const
+    {
+        uint64_t reg = 0;
+        for (size_t i = from / 8; i < in.size(); ++i)
+        {
+            reg = (reg << 8) | in[i];
+            for (int s = 7; s >= 0; --s)
+            {
+                if ((i + 1) * 8 < from + s + 48) continue;
+                const uint64_t w = (reg >> s) & kMagicMask;
+                if (w == kBlockMagic || w == kEndMagic)
+                {
+                    end = w == kEndMagic;
+                    return (i + 1) * 8 - s - 48;
+                }
+            }
+        }
+        return kNoMagic;
+    }
+
+    bool refill()
+    {
+        if (input_done) return false;
+        const size_t keep = std::min(start, scan) / 8;
+        in.erase(in.begin(), in.begin() + keep);
+        scan -= 8 * keep;
+        if (start != kNoMagic) start -= 8 * keep;
+
+        const size_t size = in.size();
+        in.resize(size + kInputChunk);
+        const size_t n = fread(&in[size], 1, kInputChunk, file);
+        in.resize(size + n);
+        if (!n) input_done = true;
+        return n > 0;
+    }
+
+    bool next_segment(BitString& segment, bool& trailer)
+    {
+        while (true)
+        {
+            bool end = false;
+            const size_t magic = find_magic(scan, end);
+            if (magic == kNoMagic)
+            {
+                if (refill()) continue;
+                if (start == kNoMagic) return false;
+                // the trailer of the last stream, or a truncated file: the last block fails to decode and is reported as an error
+                segment.append(&in[0], start, in.size() * 8 - start);
+                trailer = start_end;
+                start = kNoMagic;
+                scan = in.size() * 8;
+                return true;
+            }
+            scan = magic + 48;
+            const bool found = start != kNoMagic;
+            if (found)
+            {
+                segment.append(&in[0], start, magic - start);
+                trailer = start_end;
+            }
+            // an end-of-stream magic found by chance inside a block is a boundary like a false block magic
+            start = magic;
+            start_end = end;
+            if (found) return true;
+        }
+    }
+
+    void schedule()
+    {
+        while (!scan_done && tasks.size() < threads)
+        {
+            tasks.push_back(Task());
+            Task& task = tasks.back();
+            if (!next_segment(task.segment, task.trailer))
+            {
+                tasks.pop_back();
+                scan_done = true;
+                break;
+            }
+            task.result = std::async(std::launch::async, decode, std::cref(task.segment));
+        }
+    }
+
+    bool next_output()
+    {
+        if (status < 0) return false;
+        schedule();
+        // the end of a stream. A trailer that is part of a block was joined with the truncated block before it
+        while (!tasks.empty() && tasks.front().trailer)
+        {
+            tasks.front().result.wait();
+            tasks.pop_front();
+            schedule();
+        }
+        if (tasks.empty()) return false;
+
+        Decoded decoded = tasks.front().result.get();
+        BitString segment = std::move(tasks.front().segment);
+        tasks.pop_front();
+
+        for (unsigned int joins = 0; !decoded.ok; ++joins)
+        {
+            schedule();
+            if (tasks.empty() || joins == kMaxJoins)
+            {
+                status = -1;
+                return false;
+            }
+            tasks.front().result.wait();
+            segment.append(tasks.front().segment);
+            tasks.pop_front();
+            decoded = decode(segment);
+        }
+        current.swap(decoded.data);
+        offset = 0;
+        schedule();
+        return true;
+    }
+
+    long read(size_t num, void* bytes)
+    {
+        size_t total = 0;
+        while (total < num)
+        {
+            if (offset == current.size() && !next_output())
+                return total ? long(total) : status;
+            const size_t n = std::min(num - total, current.size() - offset);
+            memcpy((char*)bytes + total, &current[offset], n);
+            offset += n;
+            total += n;
+        }
+        return total;
+    }
+    bool seek(size_t absolute_position)
+    {
+        return false;
+    }
+    const void* view(size_t num)
+    {
+        if (offset == current.size() && !next_output()) return 0;
+        if (num > current.size() - offset) return 0;
+        const char* p = &current[offset];
+        offset += num;
+        return p;
+    }
+};
+
+FileStream* open_parallel_bz2(const char* filename, unsigned int threads)
+{
+    if (FILE* f = fopen(filename, "rb"))
+        return new ParallelBz2FileStream(f, threads);
+    return 0;
+}
@@ -9,6 +9,7 @@
 #include <corsika/particle/ParticleList.h>
 #include <corsika/Units.h>
 #include <sstream>
+#include <type_traits>
 using namespace corsika;
 
 Particle::Particle():
@@ -47,6 +48,46 @@ Particle::Particle(const ParticleData<NotThinned>& particle):
 {
 }
 
+static_assert(sizeof(ParticleRecord) == 36, "ParticleRecord is meant to stay compact");
+static_assert(std::is_trivially_copyable<ParticleRecord>::value, "ParticleRecord is copied as bytes");
+
+ParticleRecord ParticleRecord::Decode(const ParticleData<Thinned>& theParticle)
+{
+    const int code = abs(int(theParticle.fDescription/1000));
+    ParticleRecord record;
+    record.fPx = theParticle.fPx;
+    record.fPy = theParticle.fPy;
+    record.fPz = theParticle.fPz;
+    record.fX = theParticle.fX;
+    record.fY = theParticle.fY;
+    record.fTorZ = theParticle.fTorZ;
+    record.fWeight = theParticle.fWeight;
+    record.fPDGCode = ParticleList::CorsikaToPDG(code);
+    record.fCorsikaCode = code;
+    record.fHadronicGeneration = int(std::fmod(theParticle.fDescription, 1000) / 10);
+    record.fObservingLevel = int(std::fmod(theParticle.fDescription, 10)) - 1;
+    return record;
+}
+
+float ParticleRecord::Mass() const
+{
+    return ParticleList::CorsikaMass(fCorsikaCode);
+}
+
+float ParticleRecord::KineticEnergy() const
+{
+    const float momentum = Momentum();
+    const float mass = Mass();
+    return std::sqrt(momentum*momentum + mass*mass) - mass;
+}
+
+float ParticleRecord::TotalEnergy() const
+{
+    const float momentum = Momentum();
+    const float mass = Mass();
+    return std::sqrt(momentum*momentum + mass*mass);
+}
+
 int Particle::NucleusCode(const int theCharge, const int theAtomicNumber)
 {
     return NucleusProperties::TypeCode(theCharge, theAtomicNumber);
@@ -69,7 +110,7 @@ int Particle::CorsikaCode() const
 
 float Particle::Mass() const
 {
-    return ParticleList::Get(PDGCode()).GetMass();
+    return ParticleList::CorsikaMass(CorsikaCode());
 }
 
 float Particle::Momentum() const
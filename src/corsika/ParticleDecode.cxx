@@ -0,0 +1,249 @@
+/**
+ \file
+ Decoding of the particle descriptions of a whole sub-block
+
+ The records are transposed into one array per word, then split and
+ their energies computed four or eight at a time. All kernels do the
+ same single precision operations as Particle, in the same order, so
+ the results do not depend on the processor. On x86 the kernel is
+ picked at run time, like in ByteSwap.cxx, and 32 bit builds without
+ SSE2 use the scalar loops unless the processor has AVX2.
+ */
+#include <corsika/ParticleDecode.h>
+#include <corsika/particle/ParticleList.h>
+#include <cmath>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CORSIKA_DECODE_X86
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define CORSIKA_DECODE_NEON
+#endif
+
+using namespace corsika;
+
+namespace
+{
+    // id = |d| / 1000 truncated, r = |d| - 1000 id is generation * 10 + level.
+    // r is exact for whole numbers below 2^24. If the division rounded up to the next id, both are corrected
+    void split_scalar(const float* description, int32_t* code, int32_t* generation, int32_t* level, size_t n)
+    {
+        for (size_t i = 0; i != n; ++i)
+        {
+            const float a = std::fabs(description[i]);
+            int32_t id = int32_t(a / 1000.f);
+            float r = a - float(id) * 1000.f;
+            if (r < 0)
+            {
+                r += 1000.f;
+                --id;
+            }
+            const int32_t g = int32_t(r / 10.f);
+            code[i] = id;
+            generation[i] = g;
+            level[i] = int32_t(r - float(g) * 10.f - 1.f);
+        }
+    }
+
+    void energy_scalar(const float* px, const float* py, const float* pz, const float* mass, float* energy, size_t n)
+    {
+        for (size_t i = 0; i != n; ++i)
+        {
+            const float momentum = std::sqrt(px[i]*px[i] + py[i]*py[i] + pz[i]*pz[i]);
+            energy[i] = std::sqrt(momentum*momentum + mass[i]*mass[i]) - mass[i];
+        }
+    }
+
+#ifdef CORSIKA_DECODE_X86
+    __attribute__((target("avx2"))) void split_avx2(const float* description, int32_t* code, int32_t* generation,
+                                                    int32_t* level, size_t n)
+    {
+        const __m256 sign = _mm256_set1_ps(-0.f);
+        const __m256 thousand = _mm256_set1_ps(1000.f);
+        const __m256 ten = _mm256_set1_ps(10.f);
+        const __m256 one = _mm256_set1_ps(1.f);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            const __m256 a = _mm256_andnot_ps(sign, _mm256_loadu_ps(description + i));
+            __m256i id = _mm256_cvttps_epi32(_mm256_div_ps(a, thousand));
+            __m256 r = _mm256_sub_ps(a, _mm256_mul_ps(_mm256_cvtepi32_ps(id), thousand));
+            const __m256 under = _mm256_cmp_ps(r, _mm256_setzero_ps(), _CMP_LT_OQ); // all ones is -1
+            r = _mm256_add_ps(r, _mm256_and_ps(under, thousand));
+            id = _mm256_add_epi32(id, _mm256_castps_si256(under));
+            const __m256i g = _mm256_cvttps_epi32(_mm256_div_ps(r, ten));
+            const __m256 l = _mm256_sub_ps(_mm256_sub_ps(r, _mm256_mul_ps(_mm256_cvtepi32_ps(g), ten)), one);
+            _mm256_storeu_si256((__m256i*)(code + i), id);
+            _mm256_storeu_si256((__m256i*)(generation + i), g);
+            _mm256_storeu_si256((__m256i*)(level + i), _mm256_cvttps_epi32(l));
+        }
+        split_scalar(description + i, code + i, generation + i, level + i, n - i);
+    }
+
+    __attribute__((target("avx2"))) void energy_avx2(const float* px, const float* py, const float* pz,
+                                                     const float* mass, float* energy, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            const __m256 x = _mm256_loadu_ps(px + i);
+            const __m256 y = _mm256_loadu_ps(py + i);
+            const __m256 z = _mm256_loadu_ps(pz + i);
+            const __m256 m = _mm256_loadu_ps(mass + i);
+            const __m256 momentum = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)),
+                                                                 _mm256_mul_ps(z, z)));
+            const __m256 total = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(momentum, momentum), _mm256_mul_ps(m, m)));
+            _mm256_storeu_ps(energy + i, _mm256_sub_ps(total, m));
+        }
+        energy_scalar(px + i, py + i, pz + i, mass + i, energy + i, n - i);
+    }
+
+#ifdef __SSE2__
+    void split_sse2(const float* description, int32_t* code, int32_t* generation, int32_t* level, size_t n)
+    {
+        const __m128 sign = _mm_set1_ps(-0.f);
+        const __m128 thousand = _mm_set1_ps(1000.f);
+        const __m128 ten = _mm_set1_ps(10.f);
+        const __m128 one = _mm_set1_ps(1.f);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            const __m128 a = _mm_andnot_ps(sign, _mm_loadu_ps(description + i));
+            __m128i id = _mm_cvttps_epi32(_mm_div_ps(a, thousand));
+            __m128 r = _mm_sub_ps(a, _mm_mul_ps(_mm_cvtepi32_ps(id), thousand));
+            const __m128 under = _mm_cmplt_ps(r, _mm_setzero_ps()); // all ones is -1
+            r = _mm_add_ps(r, _mm_and_ps(under, thousand));
+            id = _mm_add_epi32(id, _mm_castps_si128(under));
+            const __m128i g = _mm_cvttps_epi32(_mm_div_ps(r, ten));
+            const __m128 l = _mm_sub_ps(_mm_sub_ps(r, _mm_mul_ps(_mm_cvtepi32_ps(g), ten)), one);
+            _mm_storeu_si128((__m128i*)(code + i), id);
+            _mm_storeu_si128((__m128i*)(generation + i), g);
+            _mm_storeu_si128((__m128i*)(level + i), _mm_cvttps_epi32(l));
+        }
+        split_scalar(description + i, code + i, generation + i, level + i, n - i);
+    }
+
+    void energy_sse2(const float* px, const float* py, const float* pz, const float* mass, float* energy, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            const __m128 x = _mm_loadu_ps(px + i);
+            const __m128 y = _mm_loadu_ps(py + i);
+            const __m128 z = _mm_loadu_ps(pz + i);
+            const __m128 m = _mm_loadu_ps(mass + i);
+            const __m128 momentum = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+            const __m128 total = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(momentum, momentum), _mm_mul_ps(m, m)));
+            _mm_storeu_ps(energy + i, _mm_sub_ps(total, m));
+        }
+        energy_scalar(px + i, py + i, pz + i, mass + i, energy + i, n - i);
+    }
+#endif
+
+    struct Kernels
+    {
+        void (*split)(const float*, int32_t*, int32_t*, int32_t*, size_t);
+        void (*energy)(const float*, const float*, const float*, const float*, float*, size_t);
+    };
+    Kernels select_kernels()
+    {
+        __builtin_cpu_init();
+        const Kernels avx2 = {split_avx2, energy_avx2};
+#ifdef __SSE2__
+        const Kernels baseline = {split_sse2, energy_sse2};
+#else
+        const Kernels baseline = {split_scalar, energy_scalar};
+#endif
+        return __builtin_cpu_supports("avx2") ? avx2 : baseline;
+    }
+#elif defined(CORSIKA_DECODE_NEON)
+    void split_neon(const float* description, int32_t* code, int32_t* generation, int32_t* level, size_t n)
+    {
+        const float32x4_t thousand = vdupq_n_f32(1000.f);
+        const float32x4_t ten = vdupq_n_f32(10.f);
+        const float32x4_t one = vdupq_n_f32(1.f);
+        const float32x4_t zero = vdupq_n_f32(0.f);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            const float32x4_t a = vabsq_f32(vld1q_f32(description + i));
+            int32x4_t id = vcvtq_s32_f32(vdivq_f32(a, thousand));
+            float32x4_t r = vsubq_f32(a, vmulq_f32(vcvtq_f32_s32(id), thousand));
+            const uint32x4_t under = vcltq_f32(r, zero); // all ones is -1
+            r = vaddq_f32(r, vbslq_f32(under, thousand, zero));
+            id = vaddq_s32(id, vreinterpretq_s32_u32(under));
+            const int32x4_t g = vcvtq_s32_f32(vdivq_f32(r, ten));
+            const float32x4_t l = vsubq_f32(vsubq_f32(r, vmulq_f32(vcvtq_f32_s32(g), ten)), one);
+            vst1q_s32(code + i, id);
+            vst1q_s32(generation + i, g);
+            vst1q_s32(level + i, vcvtq_s32_f32(l));
+        }
+        split_scalar(description + i, code + i, generation + i, level + i, n - i);
+    }
+
+    void energy_neon(const float* px, const float* py, const float* pz, const float* mass, float* energy, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            const float32x4_t x = vld1q_f32(px + i);
+            const float32x4_t y = vld1q_f32(py + i);
+            const float32x4_t z = vld1q_f32(pz + i);
+            const float32x4_t m = vld1q_f32(mass + i);
+            const float32x4_t momentum = vsqrtq_f32(vaddq_f32(vaddq_f32(vmulq_f32(x, x), vmulq_f32(y, y)), vmulq_f32(z, z)));
+            const float32x4_t total = vsqrtq_f32(vaddq_f32(vmulq_f32(momentum, momentum), vmulq_f32(m, m)));
+            vst1q_f32(energy + i, vsubq_f32(total, m));
+        }
+        energy_scalar(px + i, py + i, pz + i, mass + i, energy + i, n - i);
+    }
+#endif
+}
+
+namespace corsika
+{
+    template <class Thinning>
+    void DecodeParticles(const ParticleData<Thinning>* theParticles, size_t theCount, DecodedParticles& theOutput,
+                         bool theKineticEnergies)
+    {
+        if (theCount > kParticlesInBlock) theCount = kParticlesInBlock;
+        float description[kParticlesInBlock] = {};
+        float px[kParticlesInBlock] = {};
+        float py[kParticlesInBlock] = {};
+        float pz[kParticlesInBlock] = {};
+        for (size_t i = 0; i != theCount; ++i)
+        {
+            description[i] = theParticles[i].fDescription;
+            px[i] = theParticles[i].fPx;
+            py[i] = theParticles[i].fPy;
+            pz[i] = theParticles[i].fPz;
+        }
+
+#ifdef CORSIKA_DECODE_X86
+        static const Kernels kernels = select_kernels();
+        kernels.split(description, theOutput.fCorsikaCode, theOutput.fHadronicGeneration, theOutput.fObservingLevel, theCount);
+#elif defined(CORSIKA_DECODE_NEON)
+        split_neon(description, theOutput.fCorsikaCode, theOutput.fHadronicGeneration, theOutput.fObservingLevel, theCount);
+#else
+        split_scalar(description, theOutput.fCorsikaCode, theOutput.fHadronicGeneration, theOutput.fObservingLevel, theCount);
+#endif
+
+        for (size_t i = 0; i != theCount; ++i)
+            theOutput.fPDGCode[i] = ParticleList::CorsikaToPDG(theOutput.fCorsikaCode[i]);
+        if (!theKineticEnergies) return;
+        
+        float mass[kParticlesInBlock] = {};
+        for (size_t i = 0; i != theCount; ++i)
+            mass[i] = ParticleList::CorsikaMass(theOutput.fCorsikaCode[i]);
+
+#ifdef CORSIKA_DECODE_X86
+        kernels.energy(px, py, pz, mass, theOutput.fKineticEnergy, theCount);
+#elif defined(CORSIKA_DECODE_NEON)
+        energy_neon(px, py, pz, mass, theOutput.fKineticEnergy, theCount);
+#else
+        energy_scalar(px, py, pz, mass, theOutput.fKineticEnergy, theCount);
+#endif
+    }
+
+    template void DecodeParticles(const ParticleData<Thinned>*, size_t, DecodedParticles&, bool);
+    template void DecodeParticles(const ParticleData<NotThinned>*, size_t, DecodedParticles&, bool);
+}
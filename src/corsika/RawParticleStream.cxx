@@ -8,14 +8,30 @@
 
 #include <corsika/RawParticleStream.h>
 #include <corsika/IOException.h>
+#include <algorithm>
+#include <string.h>
 
 namespace corsika
 {
+    namespace
+    {
+        void copy(const ParticleData<Thinned>& in, ParticleData<Thinned>& out)
+        {
+            out = in;
+        }
+        void copy(const ParticleData<NotThinned>& in, ParticleData<Thinned>& out)
+        {
+            memcpy(&out, &in, sizeof(in));
+            out.fWeight = 1;
+        }
+    }
+    
     template <class Thinning> RawParticleStream<Thinning>::RawParticleStream(RawStreamPtr stream, size_t start):
-    stream(stream), start(start)
+    stream(stream), start(start), block(0)
     {
         // if there is something we KNOW, it is that particles are not in block zero.
         if (this->start == 0) this->start = stream->GetNextPosition();
+        stream->Advise(FileStream::kSequential, this->start);
         Rewind();
     }
     template <class Thinning> boost::optional<Particle> RawParticleStream<Thinning>::NextParticle()
@@ -24,29 +40,72 @@ namespace corsika
             return boost::optional<Particle>(Particle(*d));
         return boost::optional<Particle>();
     }
+    template <class Thinning> bool RawParticleStream<Thinning>::NextParticleData(ParticleData<Thinned>& theParticle)
+    {
+        if (!valid) return false; // stays at the end
+        const ParticleData<Thinning>* d = GetOneParticle();
+        if (!d) return false;
+        copy(*d, theParticle);
+        return true;
+    }
+    template <class Thinning> size_t RawParticleStream<Thinning>::NextParticlesData(ParticleData<Thinned>* theParticles, size_t theMax)
+    {
+        if (!valid) return 0;
+        const ParticleSpan<Thinning> span = NextBatch(theMax);
+        for (size_t i = 0; i != span.size(); ++i)
+            copy(span.first[i], theParticles[i]);
+        return span.size();
+    }
     template <class Thinning> void RawParticleStream<Thinning>::Rewind()
     {
         current_particle = kParticlesInBlock;
         valid = true;
         stream->SeekTo(start);
     }
+    template <class Thinning> bool RawParticleStream<Thinning>::NextParticleBlock()
+    {
+        if (!valid) throw IOException("RawParticleIterator not valid.");
+        
+        if (!stream->GetNextBlockView(block))
+            throw IOException("Error reading block in CORSIKA file.");
+        
+        if (block->IsControl() || block->IsLongitudinal()) // end of particle records
+        {
+            valid = false;
+            return false;
+        }
+        current_particle = 0;
+        return true;
+    }
     template <class Thinning> const ParticleData<Thinning>* RawParticleStream<Thinning>::GetOneParticle()
     {
-        if (current_particle == kParticlesInBlock)
+        if (current_particle == kParticlesInBlock && !NextParticleBlock())
+            return 0;
+        return block->AsParticleBlock.fParticle + current_particle++;
+    }
+    template <class Thinning> ParticleSpan<Thinning> RawParticleStream<Thinning>::NextBatch(size_t max)
+    {
+        static_assert(sizeof(Block<Thinning>) == kParticlesInBlock * sizeof(ParticleData<Thinning>),
+                      "particle sub-blocks must be contiguous particle records");
+        ParticleSpan<Thinning> span = {0, 0};
+        if (!max || !valid || (current_particle == kParticlesInBlock && !NextParticleBlock()))
+            return span;
+        
+        span.first = block->AsParticleBlock.fParticle + current_particle;
+        span.count = std::min(kParticlesInBlock - current_particle, max);
+        current_particle += span.count;
+        
+        // Whole particle sub-blocks that follow in the same buffer are appended. The next block is inspected
+        // in place so the one that ends the particle records is only consumed by the next call.
+        while (current_particle == kParticlesInBlock && span.count + kParticlesInBlock <= max && stream->GetBufferedBlocks())
         {
-            if (!valid) throw IOException("RawParticleIterator not valid.");
-
-            if (!stream->GetNextBlock(block))
-                throw IOException("Error reading block in CORSIKA file.");
-            
-            if (block.IsControl() || block.IsLongitudinal()) // end of particle records
-            {
-                valid = false;
-                return 0;
-            }
-            current_particle = 0;
+            const Block<Thinning>* next = reinterpret_cast<const Block<Thinning>*>(span.end());
+            if (next->IsControl() || next->IsLongitudinal())
+                break;
+            stream->GetNextBlockView(block);
+            span.count += kParticlesInBlock;
         }
-        return block.AsParticleBlock.fParticle + current_particle++;
+        return span;
     }
     
     RawParticleStreamPtr VRawParticleStream::Create(RawStreamPtr stream, size_t start)
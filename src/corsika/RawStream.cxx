@@ -8,12 +8,101 @@
  */
 #include <string>
 #include <sstream>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <sys/stat.h>
 #include <corsika/RawStream.h>
 #include <corsika/FileStream.h>
+#include <corsika/ByteSwap.h>
 
 namespace corsika
 {
-    template <typename Thinning, typename Padding> struct RawStreamT: RawStream
+    /// Reads the contents of Fortran records (length, data, length) as one stream of bytes.
+    /// Seeks assume that all records are as long as the first one, as CORSIKA writes them
+    template <typename Padding, bool Swapped> struct RecordReader
+    {
+        FileStream* file;
+        Padding marker;   // leading length of the current record, as in the file
+        size_t left;      // bytes of the current record not read yet
+        bool in_record;
+        size_t length;    // of the first record
+        Padding first_marker;
+        
+        RecordReader(FileStream* file): file(file), marker(0), left(0), in_record(false), length(0), first_marker(0) {}
+        
+        static size_t Length(Padding theMarker)
+        {
+            if (!Swapped) return size_t(theMarker);
+            return sizeof(Padding) == 4 ? SwapWord(uint32_t(theMarker)) : SwapWord(uint64_t(theMarker));
+        }
+        /// Start with the marker of the first record, already read
+        void Start(Padding theMarker)
+        {
+            marker = first_marker = theMarker;
+            left = length = Length(theMarker);
+            in_record = true;
+        }
+        /// Back to the start of a file that was opened again
+        void Reset(FileStream* theFile)
+        {
+            file = theFile;
+            left = 0;
+            in_record = false;
+        }
+        bool ReadAll(void* theBytes, size_t theNum)
+        {
+            size_t total = 0;
+            while (total < theNum)
+            {
+                const long n = file->read(theNum - total, (char*)theBytes + total);
+                if (n <= 0) return false;
+                total += n;
+            }
+            return true;
+        }
+        /// Returns the number of bytes read, less than theNum at the end of the file
+        size_t Read(void* theBytes, size_t theNum)
+        {
+            size_t total = 0;
+            while (total < theNum)
+            {
+                if (!left)
+                {
+                    if (in_record)
+                    {
+                        Padding trailer;
+                        if (!ReadAll(&trailer, sizeof(trailer))) break;
+                        if (trailer != marker) throw IOException("Record length mismatch\n");
+                        in_record = false;
+                    }
+                    if (!ReadAll(&marker, sizeof(marker))) break;
+                    left = Length(marker);
+                    in_record = true;
+                    continue;
+                }
+                const long n = file->read(std::min(theNum - total, left), (char*)theBytes + total);
+                if (n <= 0) break;
+                total += n;
+                left -= n;
+            }
+            return total;
+        }
+        /// Go to byte theOffset of the contents
+        bool Seek(size_t theOffset)
+        {
+            const size_t record = theOffset / length;
+            const size_t offset = theOffset % length;
+            if (!file->seek(record * (length + 2 * sizeof(Padding)) + sizeof(Padding) + offset)) return false;
+            marker = first_marker;
+            left = length - offset;
+            in_record = true;
+            return true;
+        }
+    };
+    
+    // Swapped: the file was written on a machine of the other byte order
+    template <typename Thinning, typename Padding, bool Swapped> struct RawStreamT: RawStream
     {
         struct DiskBlock
         {
@@ -24,34 +113,78 @@ namespace corsika
         
         boost::shared_ptr<FileStream> file;
         std::string filename;
+        FileStream::Options options;
+        bool reopenable; // a stream that can not seek is opened again to go back
         size_t current_block;
         size_t current_disk_block;
+        size_t loaded_block; // disk block `current` holds, kNotLoaded if none
         bool buffer_valid;
+        bool drop_behind;
+        size_t dropped; // bytes before this were dropped from the page cache
         DiskBlock buffer;
+        const DiskBlock* current; // either &buffer or a pointer into memory owned by the file (e.g. a mapping)
+        // Files in other records than one per disk block are read through records into the sub-blocks of the
+        // buffer, and the padding of the buffer is not used. Otherwise whole disk blocks are read at once
+        bool framed;
+        RecordReader<Padding, Swapped> records;
+        size_t loaded_count; // sub-blocks in `current`, less than kSubBlocksPerBlock only at the end of framed files
         
-        RawStreamT(boost::shared_ptr<FileStream> file, std::string filename, int64_t len64): file(file), filename(filename), current_block(0), current_disk_block(0)
+        static const size_t kNotLoaded = size_t(-1);
+        static const size_t kDropChunk = 4 << 20; // bytes dropped at a time
+        
+        RawStreamT(boost::shared_ptr<FileStream> file, std::string filename, const FileStream::Options& options, bool reopenable, int64_t len64): file(file), filename(filename), options(options), reopenable(reopenable), current_block(0), current_disk_block(0), loaded_block(0), drop_behind(false), dropped(0), current(&buffer), framed(false), records(file.get()), loaded_count(kSubBlocksPerBlock)
         {
             *reinterpret_cast<int64_t*>(&buffer) = len64; // Copy value over
             buffer_valid = file->read(sizeof(DiskBlock) - 8, (char*)&buffer + 8) > 0;
+            if (Swapped) Convert(&buffer, buffer);
+        }
+        /// Framed file, \a thePrefix holds the first bytes of the contents of its records
+        RawStreamT(boost::shared_ptr<FileStream> file, std::string filename, const FileStream::Options& options, bool reopenable, const RecordReader<Padding, Swapped>& theRecords, const std::string& thePrefix): file(file), filename(filename), options(options), reopenable(reopenable), current_block(0), current_disk_block(0), loaded_block(0), drop_behind(false), dropped(0), current(&buffer), framed(true), records(theRecords)
+        {
+            char* contents = (char*)buffer.fBlock;
+            memcpy(contents, thePrefix.data(), thePrefix.size());
+            const size_t n = thePrefix.size() + records.Read(contents + thePrefix.size(), sizeof(buffer.fBlock) - thePrefix.size());
+            loaded_count = n / sizeof(Block<Thinning>);
+            buffer_valid = loaded_count > 0;
+            if (Swapped) Convert(&buffer, buffer);
+        }
+        /// Bring a disk block to the byte order of this machine. The IDs of control blocks are text and stay as they are
+        static void Convert(const void* theInput, DiskBlock& theOutput)
+        {
+            SwapWords(theInput, &theOutput, sizeof(DiskBlock) / 4);
+            for (size_t b = 0; b != kSubBlocksPerBlock; ++b)
+            {
+                uint32_t& word = *reinterpret_cast<uint32_t*>(theOutput.fBlock[b].AsRunHeader.fID.fID);
+                word = ConvertFirstWord(SwapWord(word));
+            }
+        }
+        /// The first word of a sub-block as it is in the file, in the byte order of this machine
+        static uint32_t ConvertFirstWord(uint32_t theWord)
+        {
+            static const char* const kIDs[] = {"RUNH", "EVTH", "LONG", "EVTE", "RUNE"};
+            for (size_t i = 0; i != sizeof(kIDs) / sizeof(kIDs[0]); ++i)
+                if (!memcmp(&theWord, kIDs[i], 4)) return theWord;
+            return SwapWord(theWord);
         }
         bool valid()
         {
-            return buffer_valid && buffer.fBlock[0].IsRunHeader() && (buffer.padding_start == buffer.padding_end);
+            return buffer_valid && buffer.fBlock[0].IsRunHeader() && (framed || buffer.padding_start == buffer.padding_end);
         }
         
-        template<typename T> bool read_block(T& block)
+        template<typename T> bool view_block(const T*& block)
         {
             return false;
         }
-        bool read_block(Block<Thinning>& block)
+        bool view_block(const Block<Thinning>*& block)
         {
             if (!buffer_valid)
             {
                 if (!ReadDiskBlock())
                     return false;
             }
+            if (current_disk_block >= loaded_count) return false;
             
-            block = buffer.fBlock[current_disk_block];
+            block = current->fBlock + current_disk_block;
             if (++current_disk_block >= kSubBlocksPerBlock)
             {
                 current_block++;
@@ -60,6 +193,13 @@ namespace corsika
             }
             return true;
         }
+        template<typename T> bool read_block(T& block)
+        {
+            const T* view;
+            if (!view_block(view)) return false;
+            block = *view;
+            return true;
+        }
         bool GetNextBlock(Block<Thinned>& theBlock)
         {
             return read_block(theBlock);
@@ -68,6 +208,19 @@ namespace corsika
         {
             return read_block(theBlock);
         }
+        bool GetNextBlockView(const Block<Thinned>*& theBlock)
+        {
+            return view_block(theBlock);
+        }
+        bool GetNextBlockView(const Block<NotThinned>*& theBlock)
+        {
+            return view_block(theBlock);
+        }
+        
+        size_t GetBufferedBlocks() const
+        {
+            return buffer_valid && loaded_count > current_disk_block ? loaded_count - current_disk_block : 0;
+        }
         
         /// Number of the block read by the next call to GetNextBlock
         size_t GetNextPosition() const
@@ -75,62 +228,246 @@ namespace corsika
             return current_disk_block + kSubBlocksPerBlock * current_block;
         }
         
-        bool IsSeekable() const { return true; }
+        bool IsSeekable() const { return file->seekable || reopenable; }
+        bool SeeksByReopening() const { return !file->seekable && reopenable; }
         
         /// Seek to a given block, the next block will be \a thePosition
         void SeekTo(size_t thePosition)
         {
             size_t newBlockNumber = thePosition / kSubBlocksPerBlock;
             size_t newIndexInBlock = thePosition % kSubBlocksPerBlock;
-            //if (newBlockNumber == fCurrentBlockNumber && newIndexInBlock == fIndexInDiskBlock) return
-            if (file->seekable)
+            if (newBlockNumber == loaded_block)
+            {
+                // still in memory and the file is positioned right after it
+                current_block = newBlockNumber;
+                current_disk_block = newIndexInBlock;
+                buffer_valid = true;
+            }
+            else if (file->seekable)
             {
                 current_block = newBlockNumber;
                 buffer_valid   = false;
+                loaded_block = kNotLoaded;
                 current_disk_block   = newIndexInBlock;
-                file->seek(current_block * sizeof(DiskBlock));
+                if (framed) records.Seek(current_block * sizeof(buffer.fBlock));
+                else file->seek(current_block * sizeof(DiskBlock));
             }
             else
             {
                 if (GetNextPosition() > thePosition)
                 {
-                    file.reset(FileStream::open(filename.c_str()));
+                    if (!reopenable) throw IOException("Can not go back in '" + filename + "', it can only be read once");
+                    file.reset(FileStream::open(filename.c_str(), options));
                     if (!file) throw IOException("Failed in dumb seek");
+                    records.Reset(file.get());
                     current_block = 0;
                     current_disk_block = 0;
+                    loaded_block = kNotLoaded;
                     buffer_valid = false;
                 }
-                Block<Thinning> block;
+                const Block<Thinning>* block;
                 while (thePosition > 0 && thePosition > GetNextPosition())
-                    GetNextBlock(block);
+                    GetNextBlockView(block);
             }
         }
+        void Advise(FileStream::Advice theAdvice, size_t theFirst, size_t theCount)
+        {
+            const size_t first = theFirst / kSubBlocksPerBlock;
+            const size_t last = theCount ? (theFirst + theCount - 1) / kSubBlocksPerBlock + 1 : first;
+            file->advise(theAdvice, first * sizeof(DiskBlock), (last - first) * sizeof(DiskBlock));
+        }
+        void SetDropBehind(bool theDrop)
+        {
+            drop_behind = theDrop;
+            dropped = 0;
+        }
         bool IsThinned() const
         {
             return Thinning::kWordsPerSubBlock == Thinned::kWordsPerSubBlock;
         }
+        size_t GetNBlocks() const
+        {
+            if (framed) return 0; // no fast scan of block IDs
+            return file->size() / sizeof(DiskBlock) * kSubBlocksPerBlock;
+        }
+        // Calls theVisitor(diskBlockNumber, diskBlock, firstSubBlock, count, done) for the sub-blocks theFirst to
+        // theFirst + theCount. The disk blocks are used in place if the file is mapped, otherwise a few are read at a time.
+        // Returns the number of sub-blocks visited, fewer at the end of the file
+        template<typename Visitor> size_t VisitDiskBlocks(size_t theFirst, size_t theCount, Visitor theVisitor) const
+        {
+            const size_t kChunk = 64;
+            std::vector<DiskBlock> chunk;
+            size_t done = 0;
+            while (done < theCount)
+            {
+                const size_t diskBlock = (theFirst + done) / kSubBlocksPerBlock;
+                size_t n = std::min(kChunk, (theFirst + theCount - 1) / kSubBlocksPerBlock + 1 - diskBlock);
+                const DiskBlock* blocks = static_cast<const DiskBlock*>(file->view_at(diskBlock * sizeof(DiskBlock), n * sizeof(DiskBlock)));
+                if (!blocks)
+                {
+                    chunk.resize(n);
+                    const long bytes = file->read_at(diskBlock * sizeof(DiskBlock), n * sizeof(DiskBlock), &chunk[0]);
+                    n = bytes > 0 ? bytes / sizeof(DiskBlock) : 0;
+                    if (!n) break;
+                    blocks = &chunk[0];
+                }
+                for (size_t d = 0; d != n; ++d)
+                {
+                    const size_t b = (theFirst + done) % kSubBlocksPerBlock;
+                    const size_t count = std::min(kSubBlocksPerBlock - b, theCount - done);
+                    theVisitor(diskBlock + d, blocks[d], b, count, done);
+                    done += count;
+                }
+            }
+            return done;
+        }
+        size_t GetBlockIDs(size_t theFirst, size_t theCount, BlockInfo* theInfo) const
+        {
+            if (framed) return 0;
+            return VisitDiskBlocks(theFirst, theCount,
+                [theInfo](size_t, const DiskBlock& theBlock, size_t theSubBlock, size_t theN, size_t theDone)
+                {
+                    for (size_t i = 0; i != theN; ++i)
+                    {
+                        const RunHeader& header = theBlock.fBlock[theSubBlock + i].AsRunHeader;
+                        BlockInfo& info = theInfo[theDone + i];
+                        info.fID = header.fID;
+                        info.fWord = header.fRunNumber;
+                        if (Swapped)
+                        {
+                            uint32_t word;
+                            memcpy(&word, &header.fID, 4);
+                            word = ConvertFirstWord(word);
+                            memcpy(&info.fID, &word, 4);
+                            memcpy(&word, &header.fRunNumber, 4);
+                            word = SwapWord(word);
+                            memcpy(&info.fWord, &word, 4);
+                        }
+                    }
+                });
+        }
+        template<typename T> size_t get_blocks(size_t theFirst, size_t theCount, T* theBlocks, std::vector<size_t>& theBadRecords) const
+        {
+            return 0;
+        }
+        size_t get_blocks(size_t theFirst, size_t theCount, Block<Thinning>* theBlocks, std::vector<size_t>& theBadRecords) const
+        {
+            if (framed) return 0;
+            // the markers of a disk block hold the length of the sub-blocks, as they are in the file
+            Padding marker = sizeof(buffer.fBlock);
+            if (Swapped) marker = sizeof(Padding) == 4 ? Padding(SwapWord(uint32_t(marker))) : Padding(SwapWord(uint64_t(marker)));
+            DiskBlock converted;
+            return VisitDiskBlocks(theFirst, theCount,
+                [&](size_t theDiskBlock, const DiskBlock& theBlock, size_t theSubBlock, size_t theN, size_t theDone)
+                {
+                    const DiskBlock* block = &theBlock;
+                    if (block->padding_start != marker || block->padding_end != marker)
+                        theBadRecords.push_back(theDiskBlock * kSubBlocksPerBlock);
+                    if (Swapped)
+                    {
+                        Convert(block, converted);
+                        block = &converted;
+                    }
+                    memcpy(theBlocks + theDone, block->fBlock + theSubBlock, theN * sizeof(Block<Thinning>));
+                });
+        }
+        size_t GetBlocks(size_t theFirst, size_t theCount, Block<Thinned>* theBlocks, std::vector<size_t>& theBadRecords) const
+        {
+            return get_blocks(theFirst, theCount, theBlocks, theBadRecords);
+        }
+        size_t GetBlocks(size_t theFirst, size_t theCount, Block<NotThinned>* theBlocks, std::vector<size_t>& theBadRecords) const
+        {
+            return get_blocks(theFirst, theCount, theBlocks, theBadRecords);
+        }
         bool ReadDiskBlock()
         {
-            if (file->read(sizeof(DiskBlock), &buffer) <= 0) return false;
-            if (buffer.padding_start != buffer.padding_end) throw IOException("Padding mismatch\n");
+            if (framed) return ReadRecords();
+            const void* mapped = file->view(sizeof(DiskBlock));
+            if (mapped && !Swapped)
+                current = static_cast<const DiskBlock*>(mapped);
+            else
+            {
+                if (!mapped)
+                {
+                    if (file->read(sizeof(DiskBlock), &buffer) <= 0) return false;
+                    mapped = &buffer;
+                }
+                if (Swapped) Convert(mapped, buffer); // copied while swapping
+                current = &buffer;
+            }
+            if (current->padding_start != current->padding_end) throw IOException("Padding mismatch\n");
+            loaded_block = current_block;
+            buffer_valid = true;
+            // everything before the block just read is done with
+            const size_t consumed = current_block * sizeof(DiskBlock);
+            if (drop_behind && consumed >= dropped + kDropChunk)
+            {
+                file->advise(FileStream::kDontNeed, dropped, consumed - dropped);
+                dropped = consumed;
+            }
+            return true;
+        }
+        bool ReadRecords()
+        {
+            const size_t n = records.Read(buffer.fBlock, sizeof(buffer.fBlock));
+            if (n < sizeof(Block<Thinning>)) return false;
+            loaded_count = n / sizeof(Block<Thinning>);
+            if (Swapped) Convert(&buffer, buffer);
+            current = &buffer;
+            loaded_block = current_block;
             buffer_valid = true;
             return true;
         }
     };
-    template <typename Thinning, typename Padding>
-    RawStreamPtr create_stream(boost::shared_ptr<FileStream> file, std::string filename, int64_t len64)
+    template <typename Thinning, typename Padding, bool Swapped>
+    RawStreamPtr create_stream(boost::shared_ptr<FileStream> file, std::string filename, const FileStream::Options& options, bool reopenable, int64_t len64)
     {
-        auto ptr = new RawStreamT<Thinning, Padding>(file, filename, len64);
+        auto ptr = new RawStreamT<Thinning, Padding, Swapped>(file, filename, options, reopenable, len64);
         if (ptr->valid()) return RawStreamPtr(ptr);
         delete ptr;
         throw IOException("Not a valid corsika file\n");
     }
     
-    RawStreamPtr RawStream::Create(const std::string& filename)
+    template <typename Thinning, typename Padding, bool Swapped>
+    RawStreamPtr create_stream(boost::shared_ptr<FileStream> file, std::string filename, const FileStream::Options& options, bool reopenable, const RecordReader<Padding, Swapped>& records, const std::string& prefix)
     {
-        boost::shared_ptr<FileStream> file(FileStream::open(filename.c_str()));
-        if (!file) throw IOException("Error opening Corsika file '" + filename + "'.\n");
+        auto ptr = new RawStreamT<Thinning, Padding, Swapped>(file, filename, options, reopenable, records, prefix);
+        if (ptr->valid()) return RawStreamPtr(ptr);
+        delete ptr;
+        throw IOException("Not a valid corsika file\n");
+    }
+    
+    // Files in other records than one per disk block. The first 8 bytes, len64, were read already
+    template <typename Padding, bool Swapped>
+    RawStreamPtr create_framed(boost::shared_ptr<FileStream> file, const std::string& filename, const FileStream::Options& options, bool reopenable, int64_t len64)
+    {
+        RecordReader<Padding, Swapped> records(file.get());
+        Padding first;
+        memcpy(&first, &len64, sizeof(first));
+        records.Start(first);
+        std::string prefix((const char*)&len64 + sizeof(Padding), 8 - sizeof(Padding));
+        if (records.left < prefix.size()) throw IOException("Can't determine type of corsika file\n");
+        records.left -= prefix.size();
         
+        // the sub-block after the run header is an event header, where it is tells the size of sub-blocks
+        const size_t thinned_size = sizeof(Block<Thinned>);
+        const size_t not_thinned_size = sizeof(Block<NotThinned>);
+        const size_t have = prefix.size();
+        prefix.resize(thinned_size + 4);
+        prefix.resize(have + records.Read(&prefix[have], prefix.size() - have));
+        bool thinned = records.length % thinned_size == 0 && records.length % not_thinned_size != 0;
+        if (prefix.size() >= thinned_size + 4 && !prefix.compare(thinned_size, 4, "EVTH"))
+            thinned = true;
+        else if (prefix.size() >= not_thinned_size + 4 && !prefix.compare(not_thinned_size, 4, "EVTH"))
+            thinned = false;
+        
+        if (thinned) return create_stream<Thinned, Padding, Swapped>(file, filename, options, reopenable, records, prefix);
+        return create_stream<NotThinned, Padding, Swapped>(file, filename, options, reopenable, records, prefix);
+    }
+    
+    // Pick the layout from the first record marker. reopenable: filename can be opened again to go back in a stream that can not seek
+    static RawStreamPtr create(boost::shared_ptr<FileStream> file, const std::string& filename, const FileStream::Options& options, bool reopenable)
+    {
         int64_t len64;
         file->read(8, &len64);
         int32_t len32 = *reinterpret_cast<int32_t*>(&len64);
@@ -139,14 +476,59 @@ namespace corsika
         const int not_thinned_size = sizeof(GenericBlock<NotThinned>) * kSubBlocksPerBlock;
 
         if (len64 == thinned_size)
-            return create_stream<Thinned, int64_t>(file, filename, len64); // 64bit thinned
+            return create_stream<Thinned, int64_t, false>(file, filename, options, reopenable, len64); // 64bit thinned
         else if (len64 == not_thinned_size)
-            return create_stream<NotThinned, int64_t>(file, filename, len64); // 64bit not-thinned
+            return create_stream<NotThinned, int64_t, false>(file, filename, options, reopenable, len64); // 64bit not-thinned
         else if (len32 == thinned_size)
-            return create_stream<Thinned, int32_t>(file, filename, len64); // 32bit thinned
+            return create_stream<Thinned, int32_t, false>(file, filename, options, reopenable, len64); // 32bit thinned
         else if (len32 == not_thinned_size)
-            return create_stream<NotThinned, int32_t>(file, filename, len64); // 32bit not-thinned
+            return create_stream<NotThinned, int32_t, false>(file, filename, options, reopenable, len64); // 32bit not-thinned
+        
+        // written on a machine of the other byte order
+        const int64_t swapped64 = SwapWord(uint64_t(len64));
+        const int32_t swapped32 = SwapWord(uint32_t(len32));
+        if (swapped64 == thinned_size)
+            return create_stream<Thinned, int64_t, true>(file, filename, options, reopenable, len64);
+        else if (swapped64 == not_thinned_size)
+            return create_stream<NotThinned, int64_t, true>(file, filename, options, reopenable, len64);
+        else if (swapped32 == thinned_size)
+            return create_stream<Thinned, int32_t, true>(file, filename, options, reopenable, len64);
+        else if (swapped32 == not_thinned_size)
+            return create_stream<NotThinned, int32_t, true>(file, filename, options, reopenable, len64);
+        
+        // records of another length (MAXBUF), or disk blocks split over several records
+        const size_t kMaxRecord = 1 << 28;
+        if (!memcmp((const char*)&len64 + 4, "RUNH", 4)) // right after a 32bit marker
+        {
+            if (len32 > 0 && size_t(len32) <= kMaxRecord)
+                return create_framed<int32_t, false>(file, filename, options, reopenable, len64);
+            if (swapped32 > 0 && size_t(swapped32) <= kMaxRecord)
+                return create_framed<int32_t, true>(file, filename, options, reopenable, len64);
+        }
+        else if (len64 > 0 && size_t(len64) <= kMaxRecord)
+            return create_framed<int64_t, false>(file, filename, options, reopenable, len64);
+        else if (swapped64 > 0 && size_t(swapped64) <= kMaxRecord)
+            return create_framed<int64_t, true>(file, filename, options, reopenable, len64);
         
         throw IOException("Can't determine type of corsika file\n");
     }
+    
+    RawStreamPtr RawStream::Create(const std::string& filename, const FileStream::Options& options)
+    {
+        boost::shared_ptr<FileStream> file(FileStream::open(filename.c_str(), options));
+        if (!file) throw IOException("Error opening Corsika file '" + filename + "'.\n");
+        
+        struct stat s;
+        std::string archive, member;
+        const bool reopenable = (!stat(filename.c_str(), &s) && S_ISREG(s.st_mode)) ||
+            FileStream::archive_member(filename.c_str(), archive, member);
+        return create(file, filename, options, reopenable);
+    }
+    
+    RawStreamPtr RawStream::Create(const void* theData, size_t theSize, const boost::shared_ptr<const void>& theOwner)
+    {
+        boost::shared_ptr<FileStream> file(FileStream::open_memory(theData, theSize, theOwner));
+        if (!file) throw IOException("Error opening Corsika file in memory.\n");
+        return create(file, "<memory>", FileStream::Options(), false);
+    }
 }
@@ -21,6 +21,8 @@
 #include <string>
 #include <cmath>
 #include <iostream>
+#include <algorithm>
+#include <thread>
 
 #include <boost/tokenizer.hpp>
 #include <boost/filesystem.hpp>
@@ -47,20 +49,26 @@ static void log(const std::ostringstream& mess)
 
 
 ShowerFile::ShowerFile() :
+    fCurrentRun(0),
     fRawStream(),
     fCurrentPosition(0),
     fObservationLevel(1),
     fIsThinned(true),
-    fFileScanned(false)
+    fStreaming(false),
+    fEventOpen(false),
+    fUseIndexCache(false)
 {}
 
 
 ShowerFile::ShowerFile(const std::string& theFileName, bool requireParticleFile) :
+fCurrentRun(0),
 fRawStream(),
 fCurrentPosition(0),
 fObservationLevel(1),
 fIsThinned(true),
-fFileScanned(false)
+fStreaming(false),
+fEventOpen(false),
+fUseIndexCache(false)
 {
     // only call Open() if the particle file is required (default behaviour)
     if (requireParticleFile) Open(theFileName);
@@ -68,6 +76,33 @@ fFileScanned(false)
 
 
 void ShowerFile::Open(const std::string& theFileName, bool scan)
+{
+    OpenRawStream(theFileName);
+    fStreaming = !fRawStream->IsSeekable();
+    if (fStreaming)
+    {
+        ostringstream info;
+        info << "File " << theFileName << " does not support random access, reading it in a single pass";
+        INFO(info);
+        fRawStream->SetDropBehind(true);
+    }
+    else if (scan)
+        ScanFile();
+    if (fIsThinned) ReadRunHeader<Thinned>();
+    else ReadRunHeader<NotThinned>();
+}
+
+void ShowerFile::OpenStream(const std::string& theFileName)
+{
+    OpenRawStream(theFileName);
+    fStreaming = true;
+    fRawStream->Advise(FileStream::kSequential);
+    fRawStream->SetDropBehind(true); // read once
+    if (fIsThinned) ReadRunHeader<Thinned>();
+    else ReadRunHeader<NotThinned>();
+}
+
+void ShowerFile::OpenRawStream(const std::string& theFileName)
 {
     Close();
     
@@ -75,40 +110,42 @@ void ShowerFile::Open(const std::string& theFileName, bool scan)
     string file = theFileName;
     
     
-    bfs::path p(theFileName);
-    p.replace_extension(".long");
-    fLongFile = p.string();
-    
-    p = bfs::path(fLongFile);
-    if ( !(bfs::exists(p) && bfs::is_regular_file(p)) ) fLongFile = "";
-
-    
-    fRawStream = RawStream::Create(theFileName);
-    fIsThinned = fRawStream->IsThinned();
-    if (scan && fRawStream->IsSeekable())
+    string archive, member;
+    if (FileStream::archive_member(theFileName.c_str(), archive, member))
     {
-        fIndex.Scan(*fRawStream, false);
-        fFileScanned = true;
+        // the sibling in the same archive. Looking for it can mean reading the whole archive, so it is
+        // only done once the long file is needed
+        bfs::path p(member);
+        p.replace_extension(".long");
+        fLongFile = archive + ":" + p.string();
     }
-    else if (!fRawStream->IsSeekable())
+    else
     {
-        ostringstream msg;
-        msg << "File " << theFileName << " does not support random access. This class can not handle it";
-        throw IOException(msg.str());
+        bfs::path p(theFileName);
+        p.replace_extension(".long");
+        fLongFile = p.string();
+        
+        p = bfs::path(fLongFile);
+        if ( !(bfs::exists(p) && bfs::is_regular_file(p)) ) fLongFile = "";
     }
-    if (fIsThinned) ReadRunHeader<Thinned>();
-    else ReadRunHeader<NotThinned>();
+
+    
+    fFileName = theFileName;
+    fRawStream = RawStream::Create(theFileName);
+    fIsThinned = fRawStream->IsThinned();
+    fCurrentPosition = 0;
 }
 
 void ShowerFile::Close()
 {
     fRunHeader = corsika::RunHeader();
+    fRunHeaders.clear();
+    fCurrentRun = 0;
     fRawStream.reset();
-    
-    fIndex.eventHeaders.clear();
-    fIndex.eventTrailers.clear();
-    fIndex.longBlocks.clear();
-    fIndex.IDToPosition.clear();
+    fIndex.Clear();
+    fCorsikaLongFile.reset();
+    fStreaming = false;
+    fEventOpen = false;
 }
 
 
@@ -117,6 +154,9 @@ template <class Thinning> Status ShowerFile::Read()
     if (!fRawStream || fCurrentPosition >= fIndex.eventHeaders.size())
         return eEOF;
     
+    if (SelectRun(fIndex.eventRuns[fCurrentPosition]) != eSuccess)
+        return eFail;
+    
     fRawStream->SeekTo(fIndex.eventHeaders[fCurrentPosition]);
     
     Block<Thinning> headerBlock;
@@ -161,6 +201,30 @@ template <class Thinning> Status ShowerFile::Read()
     
     const EventTrailer& trailer = trailerBlock.AsEventTrailer;
     
+    const double timeShift = GetTimeShift(header);
+    
+    ShowerParticleStream* particleIterator =
+    new ShowerParticleStream(fRawStream,
+                             fIndex.eventHeaders[fCurrentPosition] + 1,
+                             timeShift,
+                             fObservationLevel,
+                             true); // last one is keepMuProd
+    fCurrentShower = Shower(header, trailer, particleIterator);
+    
+    if (fIndex.longBlocks.size() > 0)
+        ReadLongBlocks<Thinning>();
+    else if ( fLongFile != "" )
+        ReadLongFile();
+    
+    ++fCurrentPosition;
+    
+    return eSuccess;
+}
+
+
+// Time from the first interaction to the observation level, subtracted from particle times
+double ShowerFile::GetTimeShift(const EventHeader& header)
+{
     if (fObservationLevel > header.fObservationLevels)
     {
         ostringstream info;
@@ -214,23 +278,7 @@ template <class Thinning> Status ShowerFile::Read()
     else
         timeShift = (hReference - heightObsLevel) / (cosZenith * kSpeedOfLight);
     
-    
-    ShowerParticleStream* particleIterator =
-    new ShowerParticleStream(fRawStream,
-                             fIndex.eventHeaders[fCurrentPosition] + 1,
-                             timeShift,
-                             fObservationLevel,
-                             true); // last one is keepMuProd
-    fCurrentShower = Shower(header, trailer, particleIterator);
-    
-    if (fIndex.longBlocks.size() > 0)
-        ReadLongBlocks<Thinning>();
-    else if ( fLongFile != "" )
-        ReadLongFile();
-    
-    ++fCurrentPosition;
-    
-    return eSuccess;
+    return timeShift;
 }
 
 
@@ -248,17 +296,115 @@ template <class Thinning> Status ShowerFile::ReadRunHeader()
         return eFail;
     }
     fRunHeader = runHeaderBlock.AsRunHeader;
+    fRunHeaders[0] = fRunHeader;
+    fCurrentRun = 0;
+    // a scan of a file read once starts after the run header
+    if (fStreaming && fIndex.runHeaders.empty())
+        fIndex.AddRun(fRawStream->GetNextPosition() - 1, int(fRunHeader.fRunNumber));
     return eSuccess;
 }
 
 
+template <class Thinning> Status ShowerFile::ReadRunHeader(const unsigned int theRun)
+{
+    fRawStream->SeekTo(fIndex.runHeaders[theRun]);
+    
+    Block<Thinning> runHeaderBlock;
+    if (!fRawStream->GetNextBlock(runHeaderBlock) || !runHeaderBlock.IsRunHeader())
+    {
+        ostringstream err;
+        err << "Cannot read CORSIKA run header of run " << theRun;
+        FATAL(err);
+        return eFail;
+    }
+    fRunHeaders[theRun] = runHeaderBlock.AsRunHeader;
+    return eSuccess;
+}
+
+
+// Makes theRun (index in the file) the run of the current event
+Status ShowerFile::SelectRun(const unsigned int theRun)
+{
+    if (theRun == fCurrentRun) return eSuccess;
+    std::map<unsigned int, RunHeader>::const_iterator iter = fRunHeaders.find(theRun);
+    if (iter == fRunHeaders.end())
+    {
+        const Status status = fIsThinned ? ReadRunHeader<Thinned>(theRun) : ReadRunHeader<NotThinned>(theRun);
+        if (status != eSuccess) return status;
+        iter = fRunHeaders.find(theRun);
+    }
+    fRunHeader = iter->second;
+    fCurrentRun = theRun;
+    return eSuccess;
+}
+
+
+const RunHeader& ShowerFile::GetRunHeader(const size_t theRun)
+{
+    if (!fRawStream) throw IOException("Cannot request a run header from closed file");
+    if (!fStreaming && theRun >= fIndex.runHeaders.size())
+        ScanFile();
+    
+    std::map<unsigned int, RunHeader>::const_iterator iter = fRunHeaders.find(theRun);
+    if (iter == fRunHeaders.end() && !fStreaming && theRun < fIndex.runHeaders.size())
+    {
+        if ((fIsThinned ? ReadRunHeader<Thinned>(theRun) : ReadRunHeader<NotThinned>(theRun)) == eSuccess)
+            iter = fRunHeaders.find(theRun);
+    }
+    if (iter == fRunHeaders.end())
+    {
+        ostringstream msg;
+        msg << "There is no run " << theRun << " in " << fFileName;
+        if (fStreaming) msg << " up to the current event";
+        throw IOException(msg.str());
+    }
+    return iter->second;
+}
+
+
 Status ShowerFile::FindEvent(const unsigned int eventId)
 {
+    return FindIndexed(fIndex.IDToPosition, eventId);
+}
+
+
+Status ShowerFile::FindEvent(const int theRunNumber, const unsigned int theEventId)
+{
+    return FindIndexed(fIndex.RunEventToPosition, std::make_pair(theRunNumber, theEventId));
+}
+
+
+// Find the event at thePositions[theKey], one of the lookup tables of the index, which grows while the event is not in it
+template <class Key> Status ShowerFile::FindIndexed(const std::map<Key, unsigned int>& thePositions, const Key& theKey)
+{
+    typedef typename std::map<Key, unsigned int>::const_iterator Iterator;
     if (!IsOpen()) return eEOF;
-    const IdToPositionMap::const_iterator iter = fIndex.IDToPosition.find(eventId);
-    if (iter == fIndex.IDToPosition.end() || iter->second >= fIndex.eventHeaders.size())
+    if (fStreaming)
+    {
+        // forward only: events are skipped until the requested one shows up
+        Status status = eSuccess;
+        while (thePositions.find(theKey) == thePositions.end() && status == eSuccess)
+            status = NextEvent();
+        if (status != eSuccess) return eFail;
+        const Iterator iter = thePositions.find(theKey);
+        return iter->second + 1 == fIndex.eventHeaders.size() && fEventOpen ? eSuccess : eFail;
+    }
+    // scanned in one pass up to the trailer of the event
+    Iterator iter = thePositions.find(theKey);
+    if (iter == thePositions.end())
+    {
+        ScanFile([&]()
+        {
+            const Iterator found = thePositions.find(theKey);
+            return found != thePositions.end() && found->second < fIndex.eventTrailers.size();
+        }, false);
+        iter = thePositions.find(theKey);
+    }
+    if (iter == thePositions.end() || iter->second >= fIndex.eventTrailers.size())
         return eFail;
     
+    // header and trailer are far apart, read-ahead around them is wasted. Reading the particles asks for it again
+    fRawStream->Advise(FileStream::kRandom);
     fCurrentPosition = iter->second;
     if (fIsThinned) return Read<Thinned>();
     return Read<NotThinned>();
@@ -266,17 +412,165 @@ Status ShowerFile::FindEvent(const unsigned int eventId)
 
 
 
+Status ShowerFile::NextEvent()
+{
+    if (!IsOpen()) return eEOF;
+    if (fStreaming)
+    {
+        if (fIsThinned) return NextStreamEvent<Thinned>();
+        return NextStreamEvent<NotThinned>();
+    }
+    ScanFile(fCurrentPosition + 1);
+    if (fIsThinned) return Read<Thinned>();
+    return Read<NotThinned>();
+}
+
+
+Status ShowerFile::FinishEvent()
+{
+    if (!IsOpen() || !fEventOpen) return eSuccess;
+    if (fIsThinned) return FinishStreamEvent<Thinned>();
+    return FinishStreamEvent<NotThinned>();
+}
+
+
+template <class Thinning> Status ShowerFile::NextStreamEvent()
+{
+    if (fEventOpen && FinishEvent() != eSuccess) return eFail;
+    
+    // another run can follow the run trailer, the file ends at the end of the last one
+    const Block<Thinning>* block = 0;
+    size_t position = 0;
+    do
+    {
+        if (!fRawStream->GetNextBlockView(block))
+        {
+            fIndex.complete = !fIndex.runTrailers.empty() && fIndex.runTrailers.size() == fIndex.runHeaders.size();
+            return eEOF;
+        }
+        position = fRawStream->GetNextPosition() - 1;
+        fIndex.scannedBlocks = position + 1;
+        if (block->IsRunTrailer())
+            fIndex.runTrailers.push_back(position);
+        else if (block->IsRunHeader())
+        {
+            fIndex.AddRun(position, int(block->AsRunHeader.fRunNumber));
+            fCurrentRun = fIndex.runHeaders.size() - 1;
+            fRunHeader = block->AsRunHeader;
+            fRunHeaders[fCurrentRun] = fRunHeader;
+        }
+    } while (!block->IsEventHeader());
+    
+    const EventHeader header = block->AsEventHeader;
+    fCurrentPosition = fIndex.eventHeaders.size();
+    fIndex.AddEvent(position, (unsigned int)header.fEventNumber);
+    
+    ShowerParticleStream* particleIterator =
+    new ShowerParticleStream(fRawStream,
+                             position + 1,
+                             GetTimeShift(header),
+                             fObservationLevel,
+                             true); // last one is keepMuProd
+    fCurrentShower = Shower(header, EventTrailer(), particleIterator);
+    fEventOpen = true;
+    return eSuccess;
+}
+
+
+template <class Thinning> Status ShowerFile::FinishStreamEvent()
+{
+    fEventOpen = false;
+    
+    // reading the particles consumes the block after them, which is still in memory
+    if (fRawStream->GetNextPosition() > fIndex.eventHeaders.back() + 1)
+        fRawStream->SeekTo(fRawStream->GetNextPosition() - 1);
+    
+    const Block<Thinning>* block = 0;
+    while (fRawStream->GetNextBlockView(block))
+    {
+        const size_t position = fRawStream->GetNextPosition() - 1;
+        fIndex.scannedBlocks = position + 1;
+        if (block->IsLongitudinal() && fIndex.longBlocks.size() < fIndex.eventHeaders.size())
+        {
+            fIndex.longBlocks.push_back(position);
+            if (ReadLongBlocks<Thinning>(block) != eSuccess) return eFail;
+        }
+        else if (block->IsEventTrailer())
+        {
+            fIndex.eventTrailers.push_back(position);
+            fCurrentShower.SetEventTrailer(block->AsEventTrailer);
+            if (fIndex.longBlocks.empty() && fLongFile != "")
+                ReadLongFile();
+            return eSuccess;
+        }
+        else if (block->IsControl())
+            break;
+    }
+    ostringstream err;
+    err << "Cannot find CORSIKA shower trailer for position " << fCurrentPosition;
+    FATAL(err);
+    return eFail;
+}
+
+
 size_t ShowerFile::GetNEvents()
 {
     if (!fRawStream) throw IOException("Cannot request number of events from closed file");
-    if (!fRawStream->IsSeekable()) throw IOException("Cannot request number of events for this file. It is not seekable.");
+    if (fStreaming)
+    {
+        if (!fIndex.complete) throw IOException("The number of events in a file read in a single pass is only known at its end.");
+        return fIndex.eventHeaders.size();
+    }
+    
+    ScanFile();
+    return fIndex.eventHeaders.size();
+}
+
+
+size_t ShowerFile::GetNRuns()
+{
+    if (!fRawStream) throw IOException("Cannot request number of runs from closed file");
+    if (fStreaming)
+    {
+        if (!fIndex.complete) throw IOException("The number of runs in a file read in a single pass is only known at its end.");
+        return fIndex.runHeaders.size();
+    }
     
-    if (!fFileScanned)
+    ScanFile();
+    return fIndex.runHeaders.size();
+}
+
+
+// Index the first nEvents events
+void ShowerFile::ScanFile(size_t nEvents)
+{
+    ScanFile([this, nEvents]() { return fIndex.eventTrailers.size() >= nEvents; }, nEvents == size_t(-1));
+}
+
+
+// Index the file until theFound() is true, or all of it. A cached index is complete and is used instead if possible
+void ShowerFile::ScanFile(const std::function<bool()>& theFound, bool theAll)
+{
+    if (fIndex.complete) return;
+    const string cache = fUseIndexCache ? FileIndex::CacheName(fFileName) : "";
+    if (!fIndex.scannedBlocks && !cache.empty() && fIndex.Load(cache, fFileName)) return;
+    
+    // each scan goes back to where the file was read, which for compressed files without access points
+    // means decompressing them again from the start. These are indexed whole in one pass
+    const bool all = theAll || fRawStream->SeeksByReopening();
+    
+    // a full scan can skip particle blocks if the file allows random access
+    const unsigned int threads = std::min(8u, std::max(1u, std::thread::hardware_concurrency()));
+    if (!all)
+        fIndex.ScanUntil(*fRawStream, theFound);
+    else if (fIndex.scannedBlocks || !fIndex.ScanBlockIDs(*fRawStream, threads))
+        fIndex.ScanEvents(*fRawStream, size_t(-1));
+    if (fIndex.complete && !cache.empty() && !fIndex.Save(cache, fFileName))
     {
-        fIndex.Scan(*fRawStream, false);
-        fFileScanned = true;
+        ostringstream info;
+        info << "Could not save the index of " << fFileName << " to " << cache;
+        INFO(info);
     }
-    return fIndex.IDToPosition.size();
 }
 
 
@@ -284,9 +578,17 @@ Status ShowerFile::ReadLongFile()
 {
     //cout << "reading long file " << fLongFile << endl;
     if (!fCorsikaLongFile)
+    {
         fCorsikaLongFile.reset(new LongFile(fLongFile, GetCurrentShower().GetZenith()));
+        if (!fCorsikaLongFile->IsOpen())
+        {
+            // not in the archive after all
+            fCorsikaLongFile.reset();
+            fLongFile = "";
+        }
+    }
     
-    if (fCorsikaLongFile->size() >= fCurrentPosition)
+    if (fCorsikaLongFile && fCorsikaLongFile->size() >= fCurrentPosition)
     {
         LongProfile p = fCorsikaLongFile->GetProfile(fCurrentPosition);
         fCurrentShower.fdEdX = p.fdEdX;
@@ -333,8 +635,8 @@ template <class Thinning> Status ShowerFile::ReadLongBlocks()
 {
     fRawStream->SeekTo(fIndex.longBlocks[fCurrentPosition]);
     
-    Block<Thinning> block;
-    if (!fRawStream->GetNextBlock(block) || !block.IsLongitudinal())
+    const Block<Thinning>* block = 0;
+    if (!fRawStream->GetNextBlockView(block) || !block->IsLongitudinal())
     {
         ostringstream err;
         err << "Cannot read CORSIKA long block at position "
@@ -342,8 +644,14 @@ template <class Thinning> Status ShowerFile::ReadLongBlocks()
         FATAL(err);
         return eFail;
     }
-    
-    if (!block.IsLongitudinal())
+    return ReadLongBlocks<Thinning>(block);
+}
+
+
+// Reads the profile starting at the first long block, which was just read from the stream
+template <class Thinning> Status ShowerFile::ReadLongBlocks(const Block<Thinning>* block)
+{
+    if (!block->IsLongitudinal())
     {
         ostringstream err;
         err << "Block at position " << fCurrentPosition
@@ -351,7 +659,7 @@ template <class Thinning> Status ShowerFile::ReadLongBlocks()
         FATAL(err);
         return eFail;
     }
-    const LongitudinalBlock& longBlock = block.AsLongitudinalBlock;
+    const LongitudinalBlock& longBlock = block->AsLongitudinalBlock;
     
     
     vector<double> auxDeltaEn;
@@ -391,7 +699,7 @@ template <class Thinning> Status ShowerFile::ReadLongBlocks()
     
     for (int b = 1; b < nBlocks; ++b)
     {
-        if (!fRawStream->GetNextBlock(block) || !block.IsLongitudinal())
+        if (!fRawStream->GetNextBlockView(block) || !block->IsLongitudinal())
         {
             ostringstream err;
             err << "Cannot read CORSIKA long block #" << b << "at position "
@@ -399,7 +707,7 @@ template <class Thinning> Status ShowerFile::ReadLongBlocks()
             FATAL(err);
             return eFail;
         }
-        const LongitudinalBlock& longBlock = block.AsLongitudinalBlock;
+        const LongitudinalBlock& longBlock = block->AsLongitudinalBlock;
         for (int j = 0; j != kLongEntriesPerBlock; ++j,++i)
         {
             if (j && !longBlock.fEntries[j].fDepth)
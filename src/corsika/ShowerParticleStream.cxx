@@ -1,59 +1,142 @@
 #include <corsika/ShowerParticleStream.h>
-#include <corsika/particle/ParticleList.h>
 
 using namespace corsika;
 
 ShowerParticleStream::
 ShowerParticleStream(RawStreamPtr stream, size_t start, double timeOffset, int observationLevel, bool keepMuProd):
     stream(VRawParticleStream::Create(stream, start)), fTimeOffset(timeOffset),
-    fObservationLevel(observationLevel), fKeepMuProd(keepMuProd)
+    fObservationLevel(observationLevel), fKeepMuProd(keepMuProd), fNext(0), fCount(0)
 {
     Rewind();
 }
 
 boost::optional<Particle> ShowerParticleStream::NextParticle()
 {
-    boost::optional<Particle> parent;
-    boost::optional<Particle> grandparent;
-    boost::optional<Particle> muaddi;
-    while((value_ = stream->NextParticle()))
+    ParticleData<Thinned> record;
+    ParticleHistory history;
+    if (!NextParticle(record, history))
     {
-        int corsika_particle_id = int(value_->fDescription/1000);
-        int particleId = ParticleList::CorsikaToPDG(corsika_particle_id);
-        int obsLevel = (unsigned)value_->fDescription % 10;
-        if (value_->fDescription < 0) // history particle
+        value_ = boost::none;
+        return value_;
+    }
+    value_ = Particle(record);
+    if (history.fHasParent)
+    {
+        value_->SetParent(Particle(history.fParent));
+        value_->SetGrandParent(Particle(history.fGrandParent));
+    }
+    if (history.fHasMuonInfo) value_->SetMuonInfo(Particle(history.fMuonInfo));
+    return value_;
+}
+
+bool ShowerParticleStream::NextParticle(ParticleData<Thinned>& theParticle, ParticleHistory& theHistory)
+{
+    return Next(theParticle, &theHistory);
+}
+
+bool ShowerParticleStream::NextParticle(ParticleRecord& theParticle)
+{
+    ParticleData<Thinned> record;
+    if (!Next(record, 0)) return false;
+    MakeRecord(record, theParticle);
+    return true;
+}
+
+size_t ShowerParticleStream::NextParticles(ParticleRecord* theParticles, size_t theMax)
+{
+    ParticleData<Thinned> record;
+    size_t n = 0;
+    while (n != theMax && Next(record, 0))
+        MakeRecord(record, theParticles[n++]);
+    return n;
+}
+
+// theParticle is the one Next returned last, its description is already decoded
+void ShowerParticleStream::MakeRecord(const ParticleData<Thinned>& theParticle, ParticleRecord& theRecord) const
+{
+    const size_t i = fNext - 1;
+    theRecord.fPx = theParticle.fPx;
+    theRecord.fPy = theParticle.fPy;
+    theRecord.fPz = theParticle.fPz;
+    theRecord.fX = theParticle.fX;
+    theRecord.fY = theParticle.fY;
+    theRecord.fTorZ = theParticle.fTorZ;
+    theRecord.fWeight = theParticle.fWeight;
+    theRecord.fPDGCode = fDecoded.fPDGCode[i];
+    theRecord.fCorsikaCode = fDecoded.fCorsikaCode[i];
+    theRecord.fHadronicGeneration = fDecoded.fHadronicGeneration[i];
+    theRecord.fObservingLevel = fDecoded.fObservingLevel[i];
+}
+
+bool ShowerParticleStream::NextBatch()
+{
+    fNext = 0;
+    fCount = stream->NextParticlesData(fBatch, kParticlesInBlock);
+    if (fCount) DecodeParticles(fBatch, fCount, fDecoded, false); // nothing here reads the energies
+    return fCount;
+}
+
+// Without theHistory, history records are only skipped
+bool ShowerParticleStream::Next(ParticleData<Thinned>& theParticle, ParticleHistory* theHistory)
+{
+    // the history records are copied into theHistory as they come, these say which ones belong to the next particle
+    bool parent = false;
+    bool grandparent = false;
+    bool muaddi = false;
+    while (fNext != fCount || NextBatch())
+    {
+        const size_t i = fNext++;
+        const ParticleData<Thinned>& record = fBatch[i];
+        int corsika_particle_id = fDecoded.fCorsikaCode[i];
+        int particleId = fDecoded.fPDGCode[i];
+        int obsLevel = fDecoded.fObservingLevel[i] + 1;
+        if (record.fDescription < 0) // history particle
         {
-            if (!parent) parent = value_;
-            else grandparent = value_;
+            if (!parent)
+            {
+                if (theHistory) theHistory->fParent = record;
+                parent = true;
+            }
+            else
+            {
+                if (theHistory) theHistory->fGrandParent = record;
+                grandparent = true;
+            }
             continue;
         }
         
         if ((corsika_particle_id == 75 || corsika_particle_id == 76)  && !muaddi)
         {
-            muaddi = value_;
+            if (theHistory) theHistory->fMuonInfo = record;
+            muaddi = true;
             continue;
         }
         
         if (particleId == Particle::eUndefined || (!fKeepMuProd && (particleId == Particle::eDecayedMuon || particleId == Particle::eDecayedAntiMuon)) || obsLevel != fObservationLevel)
         {
             // reset and continue
-            parent = boost::none;
-            grandparent = boost::none;
-            muaddi = boost::none;
+            parent = false;
+            grandparent = false;
+            muaddi = false;
             continue;
         }
         
-        if (grandparent && parent)
+        if (theHistory)
         {
-            value_->SetParent(parent.get());
-            value_->SetGrandParent(grandparent.get());
+            theHistory->fHasParent = grandparent && parent;
+            theHistory->fHasMuonInfo = muaddi;
         }
-        if (muaddi) value_->SetMuonInfo(muaddi.get());
         
         // deal with corsika's idiosyncrasies here
-        value_->fTorZ -= fTimeOffset;
+        theParticle = record;
+        theParticle.fTorZ -= fTimeOffset;
         
-        break;
+        return true;
     }
-    return value_;
+    if (theHistory)
+    {
+        theHistory->fHasParent = false;
+        theHistory->fHasMuonInfo = false;
+    }
+    return false;
 }
@@ -0,0 +1,227 @@
+/**
+ \file
+ Reader for one member of a tar archive
+
+ The archive is opened like any other file, so it can be compressed.
+ Its headers are walked until the member turns up, and the member is
+ then read in place. Seeks within the member go to the same offset in
+ the archive, which is cheap for plain (mapped) archives and uses the
+ access points of .tar.gz files.
+ Understands ustar, GNU long names and pax path and size records.
+ */
+#include <corsika/FileStream.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const size_t kTarBlock = 512;
+
+    // Numeric header field: octal text, or base-256 if the high bit of the first byte is set (GNU, for large sizes)
+    bool number(const unsigned char* field, size_t size, uint64_t& value)
+    {
+        value = 0;
+        if (field[0] & 0x80)
+        {
+            value = field[0] & 0x7f;
+            for (size_t i = 1; i != size; ++i) value = value << 8 | field[i];
+            return true;
+        }
+        size_t i = 0;
+        while (i != size && field[i] == ' ') ++i;
+        if (i == size || field[i] < '0' || field[i] > '7') return false;
+        for (; i != size && field[i] >= '0' && field[i] <= '7'; ++i) value = value << 3 | (field[i] - '0');
+        return true;
+    }
+
+    bool checksum(const unsigned char* header)
+    {
+        uint64_t expected;
+        if (!number(header + 148, 8, expected)) return false;
+        uint64_t sum = 8 * ' ';
+        for (size_t i = 0; i != kTarBlock; ++i)
+            if (i < 148 || i >= 156) sum += header[i];
+        return sum == expected;
+    }
+
+    std::string field(const unsigned char* p, size_t size)
+    {
+        return std::string((const char*)p, std::find(p, p + size, 0) - p);
+    }
+
+    std::string normalize(std::string name)
+    {
+        while (name.compare(0, 2, "./") == 0) name.erase(0, 2);
+        return name;
+    }
+
+    // Reads pax records ("<length> <key>=<value>\n") that change the name or size of the next member
+    void pax(const std::string& records, std::string& path, uint64_t& size, bool& has_size)
+    {
+        size_t p = 0;
+        while (p < records.size())
+        {
+            const size_t length = strtoul(records.c_str() + p, 0, 10);
+            const size_t space = records.find(' ', p);
+            if (!length || space == std::string::npos || p + length > records.size()) return;
+            const std::string record = records.substr(space + 1, p + length - space - 2); // without the newline
+            const size_t equal = record.find('=');
+            if (equal != std::string::npos)
+            {
+                const std::string key = record.substr(0, equal);
+                if (key == "path") path = record.substr(equal + 1);
+                else if (key == "size")
+                {
+                    size = strtoull(record.c_str() + equal + 1, 0, 10);
+                    has_size = true;
+                }
+            }
+            p += length;
+        }
+    }
+
+    bool skip(FileStream& archive, uint64_t& position, uint64_t bytes)
+    {
+        position += bytes;
+        if (archive.seekable) return archive.seek(position);
+        std::vector<char> buffer(std::min<uint64_t>(bytes, 1 << 16));
+        while (bytes)
+        {
+            const long n = archive.read(std::min<uint64_t>(bytes, buffer.size()), &buffer[0]);
+            if (n <= 0) return false;
+            bytes -= n;
+        }
+        return true;
+    }
+
+    bool read_all(FileStream& archive, uint64_t& position, void* bytes, size_t num)
+    {
+        size_t total = 0;
+        while (total < num)
+        {
+            const long n = archive.read(num - total, (char*)bytes + total);
+            if (n <= 0) return false;
+            total += n;
+        }
+        position += num;
+        return true;
+    }
+}
+
+struct TarFileStream: FileStream
+{
+    FileStream* archive;
+    uint64_t offset; // of the member in the archive
+    uint64_t length;
+    uint64_t position;
+
+    TarFileStream(FileStream* archive, uint64_t offset, uint64_t length):
+    FileStream(archive->seekable), archive(archive), offset(offset), length(length), position(0) {}
+    ~TarFileStream()
+    {
+        delete archive;
+    }
+    long read(size_t num, void* bytes)
+    {
+        num = std::min<uint64_t>(num, length - position);
+        if (!num) return 0;
+        const long n = archive->read(num, bytes);
+        if (n > 0) position += n;
+        return n;
+    }
+    bool seek(size_t absolute_position)
+    {
+        if (!seekable || absolute_position > length || !archive->seek(offset + absolute_position)) return false;
+        position = absolute_position;
+        return true;
+    }
+    const void* view(size_t num)
+    {
+        if (num > length - position) return 0;
+        const void* p = archive->view(num);
+        if (p) position += num;
+        return p;
+    }
+    long read_at(size_t absolute_position, size_t num, void* bytes)
+    {
+        if (absolute_position > length) return 0;
+        return archive->read_at(offset + absolute_position, std::min<uint64_t>(num, length - absolute_position), bytes);
+    }
+    const void* view_at(size_t absolute_position, size_t num)
+    {
+        if (absolute_position > length || num > length - absolute_position) return 0;
+        return archive->view_at(offset + absolute_position, num);
+    }
+    size_t size() const { return length; }
+    bool advise(Advice advice, size_t offset, size_t length)
+    {
+        if (offset > this->length) return false;
+        if (!length || length > this->length - offset) length = this->length - offset;
+        return archive->advise(advice, this->offset + offset, length);
+    }
+};
+
+FileStream* open_tar_member(const char* archive_name, const char* member_name, const FileStream::Options& options)
+{
+    FileStream* archive = FileStream::open(archive_name, options);
+    if (!archive) return 0;
+
+    const std::string wanted = normalize(member_name);
+    unsigned char header[kTarBlock];
+    uint64_t position = 0;
+    std::string long_name, pax_path;
+    uint64_t pax_size = 0;
+    bool has_pax_size = false;
+    while (read_all(*archive, position, header, kTarBlock) && checksum(header))
+    {
+        uint64_t size;
+        if (!number(header + 124, 12, size)) break;
+        if (has_pax_size) size = pax_size;
+        const uint64_t padded = (size + kTarBlock - 1) / kTarBlock * kTarBlock;
+        const char type = header[156];
+
+        if (type == 'L' || type == 'x')
+        {
+            // the name (GNU) or pax records of the next member
+            std::string data(size, '\0');
+            if (!read_all(*archive, position, &data[0], size) || !skip(*archive, position, padded - size)) break;
+            if (type == 'L') long_name = field((const unsigned char*)data.data(), data.size());
+            else pax(data, pax_path, pax_size, has_pax_size);
+            continue;
+        }
+
+        std::string name = field(header, 100);
+        if (!memcmp(header + 257, "ustar", 5) && header[345])
+            name = field(header + 345, 155) + "/" + name;
+        if (!long_name.empty()) name = long_name;
+        if (!pax_path.empty()) name = pax_path;
+        long_name.clear();
+        pax_path.clear();
+        has_pax_size = false;
+
+        if ((type == '0' || type == '\0' || type == '7') && normalize(name) == wanted)
+            return new TarFileStream(archive, position, size);
+        if (!skip(*archive, position, padded)) break;
+    }
+    delete archive;
+    return 0;
+}
+
+bool FileStream::archive_member(const char* filename, std::string& archive, std::string& member)
+{
+    struct stat s;
+    if (!stat(filename, &s)) return false; // a file of that name
+    const std::string name(filename);
+    for (size_t colon = name.find(':'); colon != std::string::npos; colon = name.find(':', colon + 1))
+    {
+        archive = name.substr(0, colon);
+        member = name.substr(colon + 1);
+        if (!member.empty() && !stat(archive.c_str(), &s) && S_ISREG(s.st_mode)) return true;
+    }
+    return false;
+}
@@ -0,0 +1,282 @@
+/**
+ \file
+ Integrity check of Corsika files
+
+ Each range of blocks is read by itself and reduced to the blocks that
+ matter for the order (control blocks, longitudinal blocks and the first
+ block of each stretch of particle blocks). Those are then checked in
+ file order, which is quick as there are few of them.
+ */
+#include <corsika/Verify.h>
+#include <corsika/IOException.h>
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <sstream>
+#include <thread>
+
+using namespace corsika;
+
+namespace
+{
+    const size_t kMaxErrors = 100;
+    const size_t kChunk = 64 * kSubBlocksPerBlock; // blocks read at a time
+
+    enum Kind { kRunHeader, kEventHeader, kLong, kEventTrailer, kRunTrailer, kData };
+
+    // A block that matters for the order. word is the one after the ID (run or event number)
+    struct Mark
+    {
+        size_t position;
+        Kind kind;
+        float word;
+        float eventsProcessed; // of run trailers
+    };
+
+    typedef std::vector<std::pair<size_t, std::string> > Errors;
+
+    // What was found in a range of blocks
+    struct Range
+    {
+        std::vector<Mark> marks;
+        Errors errors; // the first kMaxErrors
+        size_t nErrors;
+        size_t blocks;
+        size_t particles;
+        size_t nonFinite;
+        bool inData; // the last block was a particle block
+
+        Range(): nErrors(0), blocks(0), particles(0), nonFinite(0), inData(false) {}
+
+        void Error(size_t position, const std::string& message)
+        {
+            if (errors.size() < kMaxErrors) errors.push_back(std::make_pair(position, message));
+            ++nErrors;
+        }
+    };
+
+    template <class Thinning> void Check(const Block<Thinning>& block, size_t position, Range& range)
+    {
+        ++range.blocks;
+        Mark mark = {position, kData, block.AsRunHeader.fRunNumber, 0};
+        if (block.IsRunHeader()) mark.kind = kRunHeader;
+        else if (block.IsEventHeader()) mark.kind = kEventHeader;
+        else if (block.IsLongitudinal()) mark.kind = kLong;
+        else if (block.IsEventTrailer()) mark.kind = kEventTrailer;
+        else if (block.IsRunTrailer())
+        {
+            mark.kind = kRunTrailer;
+            mark.eventsProcessed = block.AsRunTrailer.fEventsProcessed;
+        }
+        else
+        {
+            // particles. Blocks of zeros fill the disk block after the run trailer
+            const float* words = block.AsGenericBlock.fPad;
+            bool empty = true;
+            size_t bad = 0;
+            for (size_t i = 0; i != Thinning::kWordsPerSubBlock; ++i)
+            {
+                empty = empty && words[i] == 0;
+                bad += !std::isfinite(words[i]);
+            }
+            if (empty)
+            {
+                range.inData = false;
+                return;
+            }
+            for (size_t i = 0; i != kParticlesInBlock; ++i)
+                range.particles += block.AsParticleBlock.fParticle[i].fDescription != 0;
+            if (bad)
+            {
+                range.nonFinite += bad;
+                std::ostringstream msg;
+                msg << bad << " particle words are NaN or infinite";
+                range.Error(position, msg.str());
+            }
+            if (!range.inData) range.marks.push_back(mark);
+            range.inData = true;
+            return;
+        }
+        range.inData = false;
+        range.marks.push_back(mark);
+    }
+
+    // Blocks [first, last) read without moving the stream. Returns false if the stream has no random access
+    template <class Thinning> bool CheckRange(const RawStream& stream, size_t first, size_t last, Range& range)
+    {
+        std::vector<Block<Thinning> > blocks(kChunk);
+        std::vector<size_t> badRecords;
+        while (first < last)
+        {
+            const size_t n = stream.GetBlocks(first, std::min(kChunk, last - first), &blocks[0], badRecords);
+            if (!n) return false;
+            for (size_t i = 0; i != badRecords.size(); ++i)
+                range.Error(badRecords[i], "record markers do not match the length of a disk block");
+            badRecords.clear();
+            for (size_t i = 0; i != n; ++i)
+                Check(blocks[i], first + i, range);
+            first += n;
+        }
+        return true;
+    }
+
+    // Read once in file order. Reading stops at the first disk block that can not be read
+    template <class Thinning> void CheckStream(RawStream& stream, Range& range)
+    {
+        const Block<Thinning>* block = 0;
+        try
+        {
+            while (stream.GetNextBlockView(block))
+                Check(*block, stream.GetNextPosition() - 1, range);
+        }
+        catch (const IOException& e)
+        {
+            std::string message = e.what();
+            message.erase(message.find_last_not_of(" \n") + 1);
+            range.Error(stream.GetNextPosition(), "can not be read: " + message);
+        }
+    }
+
+    // The order of the blocks, in file order
+    void CheckSequence(const std::vector<Mark>& marks, VerifyReport& report, Range& range)
+    {
+        enum State { kOutside, kInRun, kInEvent, kInLong } state = kOutside;
+        float run = 0;
+        float event = 0;
+        size_t events = 0; // in the current run
+        for (size_t i = 0; i != marks.size(); ++i)
+        {
+            const Mark& mark = marks[i];
+            std::ostringstream msg;
+            switch (mark.kind)
+            {
+                case kRunHeader:
+                    if (state != kOutside) msg << "run header inside run " << run;
+                    state = kInRun;
+                    run = mark.word;
+                    events = 0;
+                    ++report.fRuns;
+                    break;
+                case kEventHeader:
+                    if (state == kOutside) msg << "event header outside of a run";
+                    else if (state != kInRun) msg << "event header before the trailer of event " << event;
+                    state = kInEvent;
+                    event = mark.word;
+                    ++events;
+                    ++report.fEvents;
+                    break;
+                case kData:
+                    if (state == kInLong) msg << "particles after the longitudinal blocks of event " << event;
+                    else if (state != kInEvent) msg << "particles outside of an event";
+                    break;
+                case kLong:
+                    if (state != kInEvent && state != kInLong) msg << "longitudinal block outside of an event";
+                    else if (mark.word != event) msg << "longitudinal block of event " << mark.word << " in event " << event;
+                    else state = kInLong;
+                    break;
+                case kEventTrailer:
+                    if (state != kInEvent && state != kInLong) msg << "event trailer without an event header";
+                    else if (mark.word != event) msg << "trailer of event " << mark.word << " ends event " << event;
+                    if (state != kOutside) state = kInRun;
+                    break;
+                case kRunTrailer:
+                    if (state == kOutside) msg << "run trailer outside of a run";
+                    else if (state != kInRun) msg << "run " << run << " ends inside event " << event;
+                    else if (mark.word != run) msg << "trailer of run " << mark.word << " ends run " << run;
+                    else if (mark.eventsProcessed != events)
+                        msg << "run " << run << " has " << events << " events, its trailer says " << mark.eventsProcessed;
+                    state = kOutside;
+                    break;
+            }
+            if (!msg.str().empty()) range.Error(mark.position, msg.str());
+        }
+        std::ostringstream msg;
+        if (state == kInRun) msg << "the file ends inside run " << run;
+        else if (state != kOutside) msg << "the file ends inside event " << event;
+        if (!msg.str().empty()) range.Error(report.fBlocks, msg.str());
+        if (!report.fRuns) range.Error(0, "there is no run header");
+    }
+
+    template <class Thinning> VerifyReport Verify(RawStream& stream, unsigned int threads)
+    {
+        if (!threads) threads = std::max(1u, std::thread::hardware_concurrency());
+        VerifyReport report;
+        std::vector<Range> ranges;
+
+        // ranges of whole disk blocks, one per thread
+        const size_t nBlocks = stream.GetNBlocks();
+        bool random = nBlocks > 0;
+        if (random)
+        {
+            const size_t nDiskBlocks = nBlocks / kSubBlocksPerBlock;
+            const size_t perThread = (nDiskBlocks + threads - 1) / threads * kSubBlocksPerBlock;
+            ranges.resize(threads);
+            std::vector<std::future<bool> > tasks;
+            for (unsigned int t = 0; t != threads; ++t)
+            {
+                const size_t first = std::min(nBlocks, t * perThread);
+                const size_t last = std::min(nBlocks, first + perThread);
+                tasks.push_back(std::async(t ? std::launch::async : std::launch::deferred,
+                                           CheckRange<Thinning>, std::cref(stream), first, last, std::ref(ranges[t])));
+            }
+            for (unsigned int t = 0; t != threads; ++t)
+                random = tasks[t].get() && random;
+        }
+        if (!random)
+        {
+            ranges.assign(1, Range());
+            stream.SeekTo(0);
+            CheckStream<Thinning>(stream, ranges[0]);
+        }
+
+        std::vector<Mark> marks;
+        Range all;
+        for (size_t t = 0; t != ranges.size(); ++t)
+        {
+            marks.insert(marks.end(), ranges[t].marks.begin(), ranges[t].marks.end());
+            all.errors.insert(all.errors.end(), ranges[t].errors.begin(), ranges[t].errors.end());
+            all.nErrors += ranges[t].nErrors;
+            report.fBlocks += ranges[t].blocks;
+            report.fParticles += ranges[t].particles;
+            report.fNonFinite += ranges[t].nonFinite;
+        }
+        CheckSequence(marks, report, all);
+
+        std::stable_sort(all.errors.begin(), all.errors.end(),
+                         [](const Errors::value_type& a, const Errors::value_type& b) { return a.first < b.first; });
+        // each range kept its first errors, so these are the first ones in the file
+        report.fNErrors = all.nErrors;
+        for (size_t i = 0; i != std::min(kMaxErrors, all.errors.size()); ++i)
+        {
+            std::ostringstream msg;
+            msg << "block " << all.errors[i].first << ": " << all.errors[i].second;
+            report.fErrors.push_back(msg.str());
+        }
+        return report;
+    }
+}
+
+VerifyReport corsika::Verify(RawStream& theStream, unsigned int theThreads)
+{
+    if (theStream.IsThinned()) return ::Verify<Thinned>(theStream, theThreads);
+    return ::Verify<NotThinned>(theStream, theThreads);
+}
+
+VerifyReport corsika::Verify(const std::string& theFileName, unsigned int theThreads)
+{
+    RawStreamPtr stream;
+    try
+    {
+        stream = RawStream::Create(theFileName);
+    }
+    catch (const IOException& e)
+    {
+        std::string message = e.what();
+        message.erase(message.find_last_not_of(" \n") + 1);
+        VerifyReport report;
+        report.fNErrors = 1;
+        report.fErrors.push_back(message);
+        return report;
+    }
+    return Verify(*stream, theThreads);
+}
@@ -0,0 +1,79 @@
+/**
+ \file
+ Reader for xz (lzma) compressed files
+
+ Only compiled with liblzma (CORSIKA_HAVE_LZMA). Concatenated .xz
+ streams are read one after the other, like xz -d does.
+ */
+#include <corsika/FileStream.h>
+#ifdef CORSIKA_HAVE_LZMA
+#include <lzma.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+struct XzFileStream: FileStream
+{
+    FILE* file;
+    lzma_stream z;
+    std::vector<unsigned char> input;
+    bool finished;
+    long status;
+
+    XzFileStream(FILE* file): FileStream(false), file(file), input(1 << 16), finished(false), status(0)
+    {
+        lzma_stream init = LZMA_STREAM_INIT;
+        z = init;
+        if (lzma_stream_decoder(&z, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+        {
+            finished = true;
+            status = -1;
+        }
+    }
+    ~XzFileStream()
+    {
+        lzma_end(&z);
+        fclose(file);
+    }
+    long read(size_t num, void* bytes)
+    {
+        z.next_out = (uint8_t*)bytes;
+        z.avail_out = num;
+        while (z.avail_out && !finished)
+        {
+            lzma_action action = LZMA_RUN;
+            if (!z.avail_in)
+            {
+                z.next_in = &input[0];
+                z.avail_in = fread(&input[0], 1, input.size(), file);
+                if (!z.avail_in) action = LZMA_FINISH;
+            }
+            lzma_ret ret = lzma_code(&z, action);
+            if (ret == LZMA_STREAM_END) finished = true;
+            else if (ret != LZMA_OK)
+            {
+                finished = true;
+                status = -1;
+            }
+        }
+        const size_t total = num - z.avail_out;
+        return total ? long(total) : status;
+    }
+    bool seek(size_t absolute_position)
+    {
+        return false;
+    }
+};
+
+FileStream* open_xz(const char* filename)
+{
+    if (FILE* f = fopen(filename, "rb"))
+        return new XzFileStream(f);
+    return 0;
+}
+#else
+FileStream* open_xz(const char* filename)
+{
+    return 0;
+}
+#endif
@@ -0,0 +1,207 @@
+/**
+ \file
+ Reader for Zstandard compressed files
+
+ Only compiled with libzstd (CORSIKA_HAVE_ZSTD). Files in the seekable
+ format (zstd/contrib/seekable_format) are made of independent frames
+ and end with a skippable frame holding the compressed and decompressed
+ size of each of them. With this seek table, a seek starts decompressing
+ at the frame that holds the target. Other files can only be read in
+ order.
+ */
+#include <corsika/FileStream.h>
+#ifdef CORSIKA_HAVE_ZSTD
+#include <zstd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    const uint32_t kSeekableMagic = 0x8F92EAB1;
+    const uint32_t kSeekTableMagic = 0x184D2A5E; // skippable frame
+    const size_t kFooterSize = 9;
+
+    inline uint32_t le32(const unsigned char* p)
+    {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+    }
+
+    // Start of each frame in the file and in the decompressed data, followed by the totals
+    struct SeekTable
+    {
+        std::vector<uint64_t> compressed;
+        std::vector<uint64_t> decompressed;
+
+        bool read(FILE* file)
+        {
+            unsigned char footer[kFooterSize];
+            if (fseeko(file, -off_t(kFooterSize), SEEK_END) || fread(footer, 1, kFooterSize, file) != kFooterSize)
+                return false;
+            if (le32(footer + 5) != kSeekableMagic) return false;
+            const uint32_t frames = le32(footer);
+            const size_t entry = (footer[4] & 0x80) ? 12 : 8; // with checksums
+            const size_t size = frames * entry + kFooterSize;
+
+            std::vector<unsigned char> table(size + 8);
+            if (fseeko(file, -off_t(table.size()), SEEK_END) || fread(&table[0], 1, table.size(), file) != table.size())
+                return false;
+            if (le32(&table[0]) != kSeekTableMagic || le32(&table[4]) != size) return false;
+
+            compressed.assign(1, 0);
+            decompressed.assign(1, 0);
+            for (uint32_t i = 0; i != frames; ++i)
+            {
+                const unsigned char* p = &table[8 + i * entry];
+                compressed.push_back(compressed.back() + le32(p));
+                decompressed.push_back(decompressed.back() + le32(p + 4));
+            }
+            return true;
+        }
+    };
+}
+
+struct ZstdFileStream: FileStream
+{
+    FILE* file;
+    SeekTable table;
+    ZSTD_DCtx* z;
+    std::vector<char> input;
+    ZSTD_inBuffer in;
+    std::vector<char> output;
+    size_t offset;       // in output
+    size_t available;    // end of the data in output
+    uint64_t position;   // decompressed offset of the next byte handed out
+    bool flushing;       // the decoder may hold more output
+    bool in_frame;       // a frame was started but not finished
+    bool finished;
+    long status;
+
+    ZstdFileStream(FILE* file, const SeekTable& table, bool seekable):
+    FileStream(seekable), file(file), table(table), z(ZSTD_createDCtx()),
+    input(ZSTD_DStreamInSize()), output(ZSTD_DStreamOutSize())
+    {
+        restart(0);
+    }
+    ~ZstdFileStream()
+    {
+        ZSTD_freeDCtx(z);
+        fclose(file);
+    }
+
+    void restart(uint64_t decompressed)
+    {
+        ZSTD_DCtx_reset(z, ZSTD_reset_session_only);
+        in.src = &input[0];
+        in.size = 0;
+        in.pos = 0;
+        offset = available = 0;
+        position = decompressed;
+        flushing = in_frame = finished = false;
+        status = 0;
+    }
+
+    bool produce()
+    {
+        while (!finished)
+        {
+            if (in.pos == in.size && !flushing)
+            {
+                in.size = fread(&input[0], 1, input.size(), file);
+                in.pos = 0;
+                if (!in.size)
+                {
+                    finished = true;
+                    if (in_frame) status = -1; // truncated
+                    return false;
+                }
+            }
+            ZSTD_outBuffer out = {&output[0], output.size(), 0};
+            const size_t ret = ZSTD_decompressStream(z, &out, &in);
+            if (ZSTD_isError(ret))
+            {
+                finished = true;
+                status = -1;
+                return false;
+            }
+            in_frame = ret != 0;
+            flushing = out.pos == out.size;
+            offset = 0;
+            available = out.pos;
+            if (available) return true;
+        }
+        return false;
+    }
+
+    long read(size_t num, void* bytes)
+    {
+        size_t total = 0;
+        while (total < num)
+        {
+            if (offset == available && !produce())
+                return total ? long(total) : status;
+            const size_t n = std::min(num - total, available - offset);
+            memcpy((char*)bytes + total, &output[offset], n);
+            offset += n;
+            position += n;
+            total += n;
+        }
+        return total;
+    }
+    bool seek(size_t absolute_position)
+    {
+        if (!seekable || absolute_position > table.decompressed.back()) return false;
+        const size_t frame = std::upper_bound(table.decompressed.begin(), table.decompressed.end() - 1, uint64_t(absolute_position))
+            - table.decompressed.begin() - 1;
+
+        // inside the frame being decompressed and ahead: keep going, otherwise start at the frame
+        if (absolute_position < position || position < table.decompressed[frame])
+        {
+            if (fseeko(file, table.compressed[frame], SEEK_SET)) return false;
+            restart(table.decompressed[frame]);
+        }
+        while (position < absolute_position)
+        {
+            if (offset == available && !produce()) return false;
+            const size_t n = std::min<uint64_t>(available - offset, absolute_position - position);
+            offset += n;
+            position += n;
+        }
+        return true;
+    }
+    const void* view(size_t num)
+    {
+        if (offset == available && !produce()) return 0;
+        if (num > available - offset) return 0;
+        const char* p = &output[offset];
+        offset += num;
+        position += num;
+        return p;
+    }
+};
+
+FileStream* open_zstd(const char* filename, bool seekable)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f) return 0;
+    SeekTable table;
+    if (seekable)
+    {
+        seekable = table.read(f);
+        if (fseeko(f, 0, SEEK_SET))
+        {
+            fclose(f);
+            return 0;
+        }
+    }
+    return new ZstdFileStream(f, table, seekable);
+}
+#else
+FileStream* open_zstd(const char* filename, bool seekable)
+{
+    return 0;
+}
+#endif
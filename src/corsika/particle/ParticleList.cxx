@@ -10,6 +10,8 @@
 #include <corsika/Particle.h>
 #include <corsika/Units.h>
 #include <corsika/IOException.h>
+#include <atomic>
+#include <mutex>
 #include <vector>
 #include <sstream>
 using namespace corsika;
@@ -62,18 +64,129 @@ namespace
     const double kKaonZeroLongLifetime  = 5.17e-8    * s;
     const double kKaonChargedLifetime   = 1.2384e-8  * s;
     */
+    
+    // Nuclei handed out by ParticleList::Get, in an open-addressed table with linear probing. Each one is
+    // created on first use and kept until the end of the program. Zero-initialized before any code runs
+    const size_t kNucleusSlots = 1024; // a power of two, far more than the nuclei of a simulation
+    std::atomic<const NucleusProperties*> gNuclei[kNucleusSlots];
+    
+    // only used once the table is full
+    std::mutex gOverflowMutex;
+    std::map<int, NucleusProperties> gOverflow;
 }
 
-std::map<int, int> ParticleList::corsikaToPDGMap_;
-std::map<int, ParticleProperties> ParticleList::particles_;
-std::map<int, NucleusProperties> ParticleList::nuclei_;
+const double ParticleList::protonMass_ = kProtonMass;
+
+// indexed by Corsika code. The codes missing from the enumeration type (anti-deltas, K* resonances...) are undefined
+const ParticleList::CorsikaCode ParticleList::corsikaCodes_[ParticleList::kNCorsikaCodes] =
+{
+    {Particle::eUndefined,        0.}, // 0
+    {Particle::ePhoton,           0.}, // 1
+    {Particle::ePositron,         kElectronMass}, // 2
+    {Particle::eElectron,         kElectronMass}, // 3
+    {Particle::eUndefined,        0.}, // 4
+    {Particle::eAntiMuon,         kMuonMass}, // 5
+    {Particle::eMuon,             kMuonMass}, // 6
+    {Particle::ePiZero,           kPiZeroMass}, // 7
+    {Particle::ePiPlus,           kPiChargedMass}, // 8
+    {Particle::ePiMinus,          kPiChargedMass}, // 9
+    {Particle::eKaon0L,           kKaonZeroMass}, // 10
+    {Particle::eKaonPlus,         kKaonChargedMass}, // 11
+    {Particle::eKaonMinus,        kKaonChargedMass}, // 12
+    {Particle::eNeutron,          kNeutronMass}, // 13
+    {Particle::eProton,           kProtonMass}, // 14
+    {Particle::eAntiProton,       kProtonMass}, // 15
+    {Particle::eKaon0S,           kKaonZeroMass}, // 16
+    {Particle::eEta,              kEtaMass}, // 17
+    {Particle::eLambda,           kLambdaMass}, // 18
+    {Particle::eSigmaPlus,        kSigmaPlusMass}, // 19
+    {Particle::eSigmaZero,        kSigmaZeroMass}, // 20
+    {Particle::eSigmaMinus,       kSigmaMinusMass}, // 21
+    {Particle::eXiZero,           kXiZeroMass}, // 22
+    {Particle::eXiMinus,          kXiMinusMass}, // 23
+    {Particle::eOmegaMinus,       kOmegaMinusMass}, // 24
+    {Particle::eAntiNeutron,      kNeutronMass}, // 25
+    {Particle::eAntiLambda,       kLambdaMass}, // 26
+    {Particle::eAntiSigmaPlus,    kSigmaPlusMass}, // 27
+    {Particle::eAntiSigmaZero,    kSigmaZeroMass}, // 28
+    {Particle::eAntiSigmaMinus,   kSigmaMinusMass}, // 29
+    {Particle::eAntiXiZero,       kXiZeroMass}, // 30
+    {Particle::eAntiXiMinus,      kXiMinusMass}, // 31, actually plus?
+    {Particle::eAntiOmegaMinus,   kOmegaMinusMass}, // 32, actually plus?
+    {Particle::eUndefined,        0.}, // 33
+    {Particle::eUndefined,        0.}, // 34
+    {Particle::eUndefined,        0.}, // 35
+    {Particle::eUndefined,        0.}, // 36
+    {Particle::eUndefined,        0.}, // 37
+    {Particle::eUndefined,        0.}, // 38
+    {Particle::eUndefined,        0.}, // 39
+    {Particle::eUndefined,        0.}, // 40
+    {Particle::eUndefined,        0.}, // 41
+    {Particle::eUndefined,        0.}, // 42
+    {Particle::eUndefined,        0.}, // 43
+    {Particle::eUndefined,        0.}, // 44
+    {Particle::eUndefined,        0.}, // 45
+    {Particle::eUndefined,        0.}, // 46
+    {Particle::eUndefined,        0.}, // 47
+    {Particle::eUndefined,        0.}, // 48
+    {Particle::eUndefined,        0.}, // 49
+    {Particle::eOmegaMeson,       kOmegaMesonMass}, // 50
+    {Particle::eRhoZero,          kRhoZeroMass}, // 51
+    {Particle::eRhoPlus,          kRhoPlusMass}, // 52
+    {Particle::eRhoMinus,         kRhoMinusMass}, // 53
+    {Particle::eDeltaPlusPlus,    kDeltaPlusPlusMass}, // 54
+    {Particle::eDeltaPlus,        kDeltaPlusMass}, // 55
+    {Particle::eDeltaZero,        kDeltaZeroMass}, // 56
+    {Particle::eDeltaMinus,       kDeltaMinusMass}, // 57
+    {Particle::eUndefined,        0.}, // 58
+    {Particle::eUndefined,        0.}, // 59
+    {Particle::eUndefined,        0.}, // 60
+    {Particle::eUndefined,        0.}, // 61
+    {Particle::eUndefined,        0.}, // 62
+    {Particle::eUndefined,        0.}, // 63
+    {Particle::eUndefined,        0.}, // 64
+    {Particle::eUndefined,        0.}, // 65
+    {Particle::eNuElectron,       0.}, // 66
+    {Particle::eAntiNuElectron,   0.}, // 67
+    {Particle::eNuMuon,           0.}, // 68
+    {Particle::eAntiNuMuon,       0.}, // 69
+    {Particle::eUndefined,        0.}, // 70
+    {Particle::eEta,              kEtaMass}, // 71
+    {Particle::eEta,              kEtaMass}, // 72
+    {Particle::eEta,              kEtaMass}, // 73
+    {Particle::eEta,              kEtaMass}, // 74
+    {Particle::eUndefined,        0.}, // 75
+    {Particle::eUndefined,        0.}, // 76
+    {Particle::eUndefined,        0.}, // 77
+    {Particle::eUndefined,        0.}, // 78
+    {Particle::eUndefined,        0.}, // 79
+    {Particle::eUndefined,        0.}, // 80
+    {Particle::eUndefined,        0.}, // 81
+    {Particle::eUndefined,        0.}, // 82
+    {Particle::eUndefined,        0.}, // 83
+    {Particle::eUndefined,        0.}, // 84
+    {Particle::eUndefined,        0.}, // 85
+    {Particle::eUndefined,        0.}, // 86
+    {Particle::eUndefined,        0.}, // 87
+    {Particle::eUndefined,        0.}, // 88
+    {Particle::eUndefined,        0.}, // 89
+    {Particle::eUndefined,        0.}, // 90
+    {Particle::eUndefined,        0.}, // 91
+    {Particle::eUndefined,        0.}, // 92
+    {Particle::eUndefined,        0.}, // 93
+    {Particle::eUndefined,        0.}, // 94
+    {Particle::eDecayedAntiMuon,  kMuonMass}, // 95
+    {Particle::eDecayedMuon,      kMuonMass}, // 96
+    {Particle::eUndefined,        0.}, // 97
+    {Particle::eUndefined,        0.}, // 98
+    {Particle::eUndefined,        0.}, // 99
+};
 
 const VParticleProperties& ParticleList::Get(int code)
 {
-    SetList();
-    
-    std::map<int,ParticleProperties>::iterator it = particles_.find(code);
-    if (it != particles_.end())
+    const std::map<int, ParticleProperties>& particles = GetList();
+    std::map<int, ParticleProperties>::const_iterator it = particles.find(code);
+    if (it != particles.end())
         return it->second;
     
     if (!NucleusProperties::IsNucleus(code))
@@ -83,170 +196,102 @@ const VParticleProperties& ParticleList::Get(int code)
         throw IOException(msg.str());
     }
     
-    nuclei_.insert(std::pair<int, NucleusProperties>(code, NucleusProperties(code)));
-    return nuclei_.find(code)->second;
-}
-
-void ParticleList::SetList()
-{
-    if (particles_.size()>0) return;
-    
-    std::vector<ParticleProperties> prop =
+    // threads that get to the same empty slot at the same time all create one, the first one stored is kept
+    const NucleusProperties* created = 0;
+    size_t slot = (unsigned(code) * 2654435761u) & (kNucleusSlots - 1);
+    for (size_t i = 0; i != kNucleusSlots; ++i, slot = (slot + 1) & (kNucleusSlots - 1))
     {
-        ParticleProperties(Particle::eUndefined,       "Undefined",       0.),
-        ParticleProperties(Particle::eElectron,        "e-",              kElectronMass),
-        ParticleProperties(Particle::ePositron,        "e+",              kElectronMass),
-        ParticleProperties(Particle::eNuElectron,      "nu_e",            0.),
-        ParticleProperties(Particle::eAntiNuElectron,  "anti_nu_e",       0.),
-        ParticleProperties(Particle::eMuon,            "mu-",             kMuonMass),
-        ParticleProperties(Particle::eAntiMuon,        "mu+",             kMuonMass),
-        ParticleProperties(Particle::eNuMuon,          "nu_mu",           0.),
-        ParticleProperties(Particle::eAntiNuMuon,      "anti_nu_mu",      0.),
-        ParticleProperties(Particle::eTau,             "tau-",            kTauMass),
-        ParticleProperties(Particle::eAntiTau,         "tau+",            kTauMass),
-        ParticleProperties(Particle::eNuTau,           "nu_tau",          0.),
-        ParticleProperties(Particle::eAntiNuTau,       "anti_nu_tau",     0.),
-        ParticleProperties(Particle::ePhoton,          "gamma",           0.),
-        ParticleProperties(Particle::ePiZero,          "pi0",             kPiZeroMass),
-        ParticleProperties(Particle::ePiPlus,          "pi+",             kPiChargedMass),
-        ParticleProperties(Particle::ePiMinus,         "pi-",             kPiChargedMass),
-        ParticleProperties(Particle::eEta,             "eta",             kEtaMass),
-        ParticleProperties(Particle::eKaon0L,          "kaon0L",          kKaonZeroMass),
-        ParticleProperties(Particle::eKaon0S,          "kaon0S",          kKaonZeroMass),
-        ParticleProperties(Particle::eKaonPlus,        "kaon+",           kKaonChargedMass),
-        ParticleProperties(Particle::eKaonMinus,       "kaon-",           kKaonChargedMass),
-        ParticleProperties(Particle::eLambda,          "lambda",          kLambdaMass),
-        ParticleProperties(Particle::eLambdac,         "lambda_c+",       kLambdacMass),
-        ParticleProperties(Particle::eAntiLambda,      "anti_lambda",     kLambdaMass),
-        ParticleProperties(Particle::eSigmaPlus,       "sigma+",          kSigmaPlusMass),
-        ParticleProperties(Particle::eSigmaZero,       "sigma0",          kSigmaZeroMass),
-        ParticleProperties(Particle::eSigmaMinus,      "sigma-",          kSigmaMinusMass),
-        ParticleProperties(Particle::eAntiSigmaPlus,   "anti_sigma+",     kSigmaPlusMass),
-        ParticleProperties(Particle::eAntiSigmaZero,   "anti_sigma0",     kSigmaZeroMass),
-        ParticleProperties(Particle::eAntiSigmaMinus,  "anti_sigma-",     kSigmaMinusMass),
-        ParticleProperties(Particle::eXiZero,          "xi0",             kXiZeroMass),
-        ParticleProperties(Particle::eXiMinus,         "xi-",             kXiMinusMass),
-        ParticleProperties(Particle::eAntiXiZero,      "anti_xi0",        kXiZeroMass),
-        ParticleProperties(Particle::eAntiXiMinus,     "anti_xi-",        kXiMinusMass),
-        ParticleProperties(Particle::eOmegaMinus,      "omega-",          kOmegaMinusMass),
-        ParticleProperties(Particle::eAntiOmegaMinus,  "anti_omega-",     kOmegaMinusMass),
-        ParticleProperties(Particle::eNeutron,         "neutron",         kNeutronMass),
-        ParticleProperties(Particle::eAntiNeutron,     "anti_neutron",    kNeutronMass),
-        ParticleProperties(Particle::eProton,          "proton",          kProtonMass),
-        ParticleProperties(Particle::eAntiProton,      "anti_proton",     kProtonMass),
-        ParticleProperties(Particle::eRhoZero,         "rho_zero",        kRhoZeroMass),
-        ParticleProperties(Particle::eRhoPlus,         "rho_plus",        kRhoPlusMass),
-        ParticleProperties(Particle::eRhoMinus,        "rho_minus",       kRhoMinusMass),
-        ParticleProperties(Particle::eOmegaMeson,      "omega_meson",     kOmegaMesonMass),
-        ParticleProperties(Particle::eDeltaMinus,      "delta_minus",     kDeltaMinusMass),
-        ParticleProperties(Particle::eDeltaZero,       "delta_zero",      kDeltaZeroMass),
-        ParticleProperties(Particle::eDeltaPlus,       "delta_plus",      kDeltaPlusMass),
-        ParticleProperties(Particle::eDeltaPlusPlus,   "delta_plus_plus", kDeltaPlusPlusMass),
-        ParticleProperties(Particle::eDecayedMuon,     "decayed mu-",     kMuonMass),
-        ParticleProperties(Particle::eDecayedAntiMuon, "decayed mu+",     kMuonMass),
-    };
+        const NucleusProperties* current = gNuclei[slot].load(std::memory_order_acquire);
+        if (!current)
+        {
+            if (!created) created = new NucleusProperties(code);
+            if (gNuclei[slot].compare_exchange_strong(current, created, std::memory_order_acq_rel, std::memory_order_acquire))
+                return *created;
+        }
+        if (current->GetType() == code)
+        {
+            delete created;
+            return *current;
+        }
+    }
+    delete created;
     
-    for (auto& p: prop)
-        if (particles_.find(p.GetType()) == particles_.end())
-            particles_.insert(std::pair<int, ParticleProperties>(p.GetType(), p));
+    std::lock_guard<std::mutex> lock(gOverflowMutex);
+    return gOverflow.insert(std::pair<int, NucleusProperties>(code, NucleusProperties(code))).first->second;
 }
 
-void ParticleList::InitCorsikaToPDGMap()
+namespace
 {
-    corsikaToPDGMap_ =
+    std::map<int, ParticleProperties> MakeList()
     {
-        {1, Particle::ePhoton},
-        {2, Particle::ePositron},
-        {3, Particle::eElectron},
-        
-        {5, Particle::eAntiMuon},
-        {6, Particle::eMuon},
-        {7, Particle::ePiZero},
-        {8, Particle::ePiPlus},
-        {9, Particle::ePiMinus},
-        
-        {10, Particle::eKaon0L},
-        {11, Particle::eKaonPlus},
-        {12, Particle::eKaonMinus},
-        {13, Particle::eNeutron},
-        {14, Particle::eProton},
-        {15, Particle::eAntiProton},
-        {16, Particle::eKaon0S},
-        {17, Particle::eEta},
-        {18, Particle::eLambda},
-        
-        {19, Particle::eSigmaPlus},
-        {20, Particle::eSigmaZero},
-        {21, Particle::eSigmaMinus},
-        {22, Particle::eXiZero},
-        {23, Particle::eXiMinus},
-        {24, Particle::eOmegaMinus},
+        std::vector<ParticleProperties> prop =
+        {
+            ParticleProperties(Particle::eUndefined,       "Undefined",       0.),
+            ParticleProperties(Particle::eElectron,        "e-",              kElectronMass),
+            ParticleProperties(Particle::ePositron,        "e+",              kElectronMass),
+            ParticleProperties(Particle::eNuElectron,      "nu_e",            0.),
+            ParticleProperties(Particle::eAntiNuElectron,  "anti_nu_e",       0.),
+            ParticleProperties(Particle::eMuon,            "mu-",             kMuonMass),
+            ParticleProperties(Particle::eAntiMuon,        "mu+",             kMuonMass),
+            ParticleProperties(Particle::eNuMuon,          "nu_mu",           0.),
+            ParticleProperties(Particle::eAntiNuMuon,      "anti_nu_mu",      0.),
+            ParticleProperties(Particle::eTau,             "tau-",            kTauMass),
+            ParticleProperties(Particle::eAntiTau,         "tau+",            kTauMass),
+            ParticleProperties(Particle::eNuTau,           "nu_tau",          0.),
+            ParticleProperties(Particle::eAntiNuTau,       "anti_nu_tau",     0.),
+            ParticleProperties(Particle::ePhoton,          "gamma",           0.),
+            ParticleProperties(Particle::ePiZero,          "pi0",             kPiZeroMass),
+            ParticleProperties(Particle::ePiPlus,          "pi+",             kPiChargedMass),
+            ParticleProperties(Particle::ePiMinus,         "pi-",             kPiChargedMass),
+            ParticleProperties(Particle::eEta,             "eta",             kEtaMass),
+            ParticleProperties(Particle::eKaon0L,          "kaon0L",          kKaonZeroMass),
+            ParticleProperties(Particle::eKaon0S,          "kaon0S",          kKaonZeroMass),
+            ParticleProperties(Particle::eKaonPlus,        "kaon+",           kKaonChargedMass),
+            ParticleProperties(Particle::eKaonMinus,       "kaon-",           kKaonChargedMass),
+            ParticleProperties(Particle::eLambda,          "lambda",          kLambdaMass),
+            ParticleProperties(Particle::eLambdac,         "lambda_c+",       kLambdacMass),
+            ParticleProperties(Particle::eAntiLambda,      "anti_lambda",     kLambdaMass),
+            ParticleProperties(Particle::eSigmaPlus,       "sigma+",          kSigmaPlusMass),
+            ParticleProperties(Particle::eSigmaZero,       "sigma0",          kSigmaZeroMass),
+            ParticleProperties(Particle::eSigmaMinus,      "sigma-",          kSigmaMinusMass),
+            ParticleProperties(Particle::eAntiSigmaPlus,   "anti_sigma+",     kSigmaPlusMass),
+            ParticleProperties(Particle::eAntiSigmaZero,   "anti_sigma0",     kSigmaZeroMass),
+            ParticleProperties(Particle::eAntiSigmaMinus,  "anti_sigma-",     kSigmaMinusMass),
+            ParticleProperties(Particle::eXiZero,          "xi0",             kXiZeroMass),
+            ParticleProperties(Particle::eXiMinus,         "xi-",             kXiMinusMass),
+            ParticleProperties(Particle::eAntiXiZero,      "anti_xi0",        kXiZeroMass),
+            ParticleProperties(Particle::eAntiXiMinus,     "anti_xi-",        kXiMinusMass),
+            ParticleProperties(Particle::eOmegaMinus,      "omega-",          kOmegaMinusMass),
+            ParticleProperties(Particle::eAntiOmegaMinus,  "anti_omega-",     kOmegaMinusMass),
+            ParticleProperties(Particle::eNeutron,         "neutron",         kNeutronMass),
+            ParticleProperties(Particle::eAntiNeutron,     "anti_neutron",    kNeutronMass),
+            ParticleProperties(Particle::eProton,          "proton",          kProtonMass),
+            ParticleProperties(Particle::eAntiProton,      "anti_proton",     kProtonMass),
+            ParticleProperties(Particle::eRhoZero,         "rho_zero",        kRhoZeroMass),
+            ParticleProperties(Particle::eRhoPlus,         "rho_plus",        kRhoPlusMass),
+            ParticleProperties(Particle::eRhoMinus,        "rho_minus",       kRhoMinusMass),
+            ParticleProperties(Particle::eOmegaMeson,      "omega_meson",     kOmegaMesonMass),
+            ParticleProperties(Particle::eDeltaMinus,      "delta_minus",     kDeltaMinusMass),
+            ParticleProperties(Particle::eDeltaZero,       "delta_zero",      kDeltaZeroMass),
+            ParticleProperties(Particle::eDeltaPlus,       "delta_plus",      kDeltaPlusMass),
+            ParticleProperties(Particle::eDeltaPlusPlus,   "delta_plus_plus", kDeltaPlusPlusMass),
+            ParticleProperties(Particle::eDecayedMuon,     "decayed mu-",     kMuonMass),
+            ParticleProperties(Particle::eDecayedAntiMuon, "decayed mu+",     kMuonMass),
+        };
         
-        {25, Particle::eAntiNeutron},
-        {26, Particle::eAntiLambda},
-        
-        {27, Particle::eAntiSigmaPlus},
-        {28, Particle::eAntiSigmaZero},
-        {29, Particle::eAntiSigmaMinus},
-        {30, Particle::eAntiXiZero},
-        {31, Particle::eAntiXiMinus}, // actually plus?
-        {32, Particle::eAntiOmegaMinus}, // actually plus?
-        
-        {50, Particle::eOmegaMeson},
-        {51, Particle::eRhoZero},
-        {52, Particle::eRhoPlus},
-        {53, Particle::eRhoMinus},
-        {54, Particle::eDeltaPlusPlus},
-        {55, Particle::eDeltaPlus},
-        {56, Particle::eDeltaZero},
-        {57, Particle::eDeltaMinus},
-        
-        // not in the enumeration type
-        // {58, Particle::eAntiDeltaPlusPlus},
-        // {59, Particle::eAntiDeltaPlus},
-        // {60, Particle::eAntiDeltaZero},
-        // {61, Particle::eAntiDeltaMinus},
-        // {62, Particle::eKZeroResonance},
-        // {63, Particle::eKPlusResonance},
-        // {64, Particle::eKMinusResonance},
-        // {65, Particle::eAntiKZeroResonance},
-        
-        {66, Particle::eNuElectron},
-        {67, Particle::eAntiNuElectron},
-        {68, Particle::eNuMuon},
-        {69, Particle::eAntiNuMuon},
-        
-        {71, Particle::eEta},
-        {72, Particle::eEta},
-        {73, Particle::eEta},
-        {74, Particle::eEta},
-        
-        {95, Particle::eDecayedAntiMuon},
-        {96, Particle::eDecayedMuon},
-    };
+        std::map<int, ParticleProperties> particles;
+        for (auto& p: prop)
+            if (particles.find(p.GetType()) == particles.end())
+                particles.insert(std::pair<int, ParticleProperties>(p.GetType(), p));
+        return particles;
+    }
 }
 
-int ParticleList::CorsikaToPDG(int theCorsikaCode)
+const std::map<int, ParticleProperties>& ParticleList::GetList()
 {
-    if (theCorsikaCode < 100)
-    {
-        if (!corsikaToPDGMap_.size()) InitCorsikaToPDGMap();
-        
-        auto index = corsikaToPDGMap_.find(theCorsikaCode);
-        
-        if (index != corsikaToPDGMap_.end())
-            return index->second;
-        else
-            return Particle::eUndefined;
-    }
-    else if (theCorsikaCode < 9900) // nucleus
-    {
-        int Z = theCorsikaCode % 100;
-        int A = theCorsikaCode / 100;
-        return Particle::NucleusCode(Z, A);
-    }
-    // Cherenkov
-    return Particle::eUndefined;
+    // initialized once, even when several threads get here at the same time
+    static const std::map<int, ParticleProperties> particles = MakeList();
+    return particles;
 }
 
 std::string ParticleList::NameFromPDG(int pdgCode)
@@ -16,6 +16,14 @@ public:
   {
     return this->get_override("GetParticle")();
   }
+  bool NextParticleData(corsika::ParticleData<corsika::Thinned>& theParticle)
+  {
+    const boost::optional<corsika::Particle> p = NextParticle();
+    if (!p) return false;
+    const corsika::ParticleData<corsika::Thinned> record = {p->fDescription, p->fPx, p->fPy, p->fPz, p->fX, p->fY, p->fTorZ, p->fWeight};
+    theParticle = record;
+    return true;
+  }
   void Rewind()
   {
     this->Rewind();
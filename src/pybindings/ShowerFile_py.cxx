@@ -61,15 +61,27 @@ void register_ShowerFile()
     ;
 
   Shower& (ShowerFile::*get_current)() = &ShowerFile::GetCurrentShower;
+  Status (ShowerFile::*find_event)(unsigned int) = &ShowerFile::FindEvent;
+  Status (ShowerFile::*find_run_event)(int, unsigned int) = &ShowerFile::FindEvent;
+  const RunHeader& (ShowerFile::*get_run_header)() const = &ShowerFile::GetRunHeader;
+  const RunHeader& (ShowerFile::*get_nth_run_header)(size_t) = &ShowerFile::GetRunHeader;
 
   class_<ShowerFile, boost::noncopyable>("ShowerFile")
     .def(init<const std::string&, bool>())
     .def(init<const std::string&>())
     .def("open", &ShowerFile::Open) // would need to overload for the default second parameter (true)
     .def("close", &ShowerFile::Close)
-    .def("find_event", &ShowerFile::FindEvent)
-    .add_property("run_header", make_function(&ShowerFile::GetRunHeader, return_internal_reference<>()))
+    .def("find_event", find_event)
+    .def("find_event", find_run_event)
+    .def("open_stream", &ShowerFile::OpenStream)
+    .def("next_event", &ShowerFile::NextEvent)
+    .def("finish_event", &ShowerFile::FinishEvent)
+    .add_property("streaming", &ShowerFile::IsStreaming)
+    .def("set_index_cache", &ShowerFile::SetIndexCache)
+    .add_property("run_header", make_function(get_run_header, return_internal_reference<>()))
+    .def("get_run_header", get_nth_run_header, return_internal_reference<>())
     .add_property("n_events", &ShowerFile::GetNEvents)
+    .add_property("n_runs", &ShowerFile::GetNRuns)
     .def("events", get_shower_iterator)
     //.staticmethod("IsValid")
     .add_property("current_shower", make_function(get_current, return_internal_reference<>()))
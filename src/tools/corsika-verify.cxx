@@ -0,0 +1,68 @@
+/**
+ \file
+ Check that Corsika files are complete and not corrupted
+
+ Usage: corsika-verify [-j threads] [-q] file...
+
+ Prints what was found in each file and the problems, if any. The exit
+ status is 0 if all files are fine, 1 otherwise, so that it can gate
+ the ingestion of files.
+ */
+#include <corsika/Verify.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <chrono>
+
+using namespace corsika;
+
+static void usage()
+{
+    printf("Usage: corsika-verify [-j threads] [-q] file...\n"
+           "  -j threads  check each file on this many threads (default: one per core)\n"
+           "  -q          only print the files with problems\n");
+}
+
+int main(int argc, const char* argv[])
+{
+    unsigned int threads = 0;
+    bool quiet = false;
+    int first = 1;
+    for (; first < argc && argv[first][0] == '-' && argv[first][1]; ++first)
+    {
+        if (!strcmp(argv[first], "-q")) quiet = true;
+        else if (!strcmp(argv[first], "-j") && first + 1 < argc) threads = atoi(argv[++first]);
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    if (first == argc)
+    {
+        usage();
+        return 2;
+    }
+
+    int status = 0;
+    for (int i = first; i != argc; ++i)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const VerifyReport report = Verify(argv[i], threads);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (!report.IsValid()) status = 1;
+        if (quiet && report.IsValid()) continue;
+        struct stat s;
+        const double megabytes = stat(argv[i], &s) ? 0 : s.st_size / 1e6;
+        printf("%s: %s, %zu runs, %zu events, %zu particles, %zu blocks in %.2f s (%.0f MB/s)\n",
+               argv[i], report.IsValid() ? "OK" : "CORRUPT", report.fRuns, report.fEvents, report.fParticles,
+               report.fBlocks, seconds, seconds > 0 ? megabytes / seconds : 0.);
+        for (size_t e = 0; e != report.fErrors.size(); ++e)
+            printf("  %s\n", report.fErrors[e].c_str());
+        if (report.fNErrors > report.fErrors.size())
+            printf("  ... and %zu more\n", report.fNErrors - report.fErrors.size());
+    }
+    return status;
+}
@@ -1,4 +1,10 @@
 #include "tests.h"
+#include <corsika/particle/ParticleList.h>
+#include <corsika/LongFile.h>
+#include <zlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <thread>
 namespace
 {
     void test_header(std::string filename)
@@ -46,6 +52,360 @@ namespace
         }
         assert(count == 181992);
     }
+    
+    void test_records(std::string filename)
+    {
+        ShowerFile file(filename);
+        file.FindEvent(1);
+        auto& stream = file.GetCurrentShower().ParticleStream();
+        std::vector<Particle> particles;
+        while (auto p = stream.NextParticle())
+            particles.push_back(*p);
+        
+        stream.Rewind();
+        std::vector<ParticleRecord> records(1000);
+        size_t count = 0;
+        while (size_t n = stream.NextParticles(&records[0], records.size()))
+        {
+            for (size_t i = 0; i != n; ++i, ++count)
+            {
+                const Particle& p = particles[count];
+                const ParticleRecord& r = records[i];
+                ENSURE_EQUAL(r.fPDGCode, p.PDGCode());
+                ENSURE_EQUAL(r.fCorsikaCode, p.CorsikaCode());
+                ENSURE_EQUAL(r.fHadronicGeneration, p.HadronicGeneration());
+                ENSURE_EQUAL(r.fObservingLevel, p.ObservingLevel());
+                assert(r.fPx == p.fPx && r.fX == p.fX && r.fTorZ == p.fTorZ && r.fWeight == p.fWeight);
+                assert(r.KineticEnergy() == p.KineticEnergy());
+            }
+        }
+        ENSURE_EQUAL(count, particles.size());
+        
+        stream.Rewind();
+        ParticleRecord first;
+        assert(stream.NextParticle(first));
+        ENSURE_EQUAL(first.fPDGCode, Particle::eMuon);
+        
+        // level digit 0, as in empty records
+        ParticleData<Thinned> empty = {6000, 0, 0, 1, 0, 0, 0, 1};
+        ENSURE_EQUAL(ParticleRecord::Decode(empty).fObservingLevel, -1);
+        ENSURE_EQUAL(ParticleRecord::Decode(empty).fObservingLevel, Particle(empty).ObservingLevel());
+    }
+    
+    void test_particle_list()
+    {
+        // the list used from several threads at once hands out one object per particle
+        std::vector<const VParticleProperties*> iron(4);
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t != iron.size(); ++t)
+            threads.push_back(std::thread([&iron, t]()
+            {
+                for (int code = 5600; code != 5700; ++code)
+                    assert(ParticleList::Get(ParticleList::CorsikaToPDG(code)).GetMass() > 0);
+                iron[t] = &ParticleList::Get(Particle::eIron);
+            }));
+        for (size_t t = 0; t != threads.size(); ++t)
+            threads[t].join();
+        for (size_t t = 0; t != iron.size(); ++t)
+            assert(iron[t] == &ParticleList::Get(Particle::eIron));
+        
+        // the tables of Corsika codes against the particle list
+        for (int code = 0; code != 10000; ++code)
+            ENSURE_EQUAL(ParticleList::CorsikaMass(code), ParticleList::Get(ParticleList::CorsikaToPDG(code)).GetMass());
+        // more nuclei than the cache has slots, the rest are kept aside
+        for (int code = 100; code != 9900; ++code)
+            assert(&ParticleList::Get(ParticleList::CorsikaToPDG(code)) == &ParticleList::Get(ParticleList::CorsikaToPDG(code)));
+        ENSURE_EQUAL(ParticleList::CorsikaToPDG(14), Particle::eProton);
+        ENSURE_EQUAL(ParticleList::CorsikaToPDG(5626), Particle::eIron);
+        ENSURE_EQUAL(ParticleList::CorsikaToPDG(9900), Particle::eUndefined);
+        ENSURE_EQUAL(ParticleList::CorsikaToPDG(-14), Particle::eUndefined);
+        ENSURE_EQUAL(ParticleList::CorsikaMass(-5626), 0);
+    }
+    
+    void test_index_cache(std::string filename, std::string other)
+    {
+        RawStreamPtr stream = RawStream::Create(filename);
+        FileIndex index;
+        index.Scan(*stream, false);
+        
+        const std::string cache = "test_index_cache.idx";
+        assert(index.Save(cache, filename));
+        FileIndex loaded;
+        assert(loaded.Load(cache, filename));
+        ENSURE_EQUAL(loaded.runNumber, index.runNumber);
+        assert(loaded.eventHeaders == index.eventHeaders);
+        assert(loaded.eventTrailers == index.eventTrailers);
+        assert(loaded.longBlocks == index.longBlocks);
+        assert(loaded.IDToPosition == index.IDToPosition);
+        
+        // the index belongs to one file only
+        FileIndex wrong;
+        assert(!wrong.Load(cache, other));
+        assert(wrong.eventHeaders.empty());
+        
+        // stale or truncated caches are not used: a second event, with longitudinal blocks for one of them
+        FileIndex two = index;
+        two.runTrailers[0] += 200;
+        two.AddEvent(index.runTrailers[0] + 50, 2);
+        two.eventTrailers.push_back(index.runTrailers[0] + 100);
+        two.longBlocks.assign(1, index.eventTrailers[0] - 1);
+        assert(two.Save(cache, filename));
+        assert(!wrong.Load(cache, filename));
+        two.longBlocks.push_back(index.runTrailers[0] + 99);
+        assert(two.Save(cache, filename));
+        assert(wrong.Load(cache, filename));
+        ENSURE_EQUAL(wrong.eventHeaders.size(), 2);
+        
+        FileIndex unordered = index;
+        unordered.eventTrailers[0] = unordered.eventHeaders[0];
+        assert(unordered.Save(cache, filename));
+        FileIndex rejected;
+        assert(!rejected.Load(cache, filename));
+        FileIndex repeated = index;
+        repeated.AddEvent(index.eventHeaders[0], index.eventNumbers[0]);
+        repeated.eventTrailers.push_back(index.eventTrailers[0]);
+        assert(repeated.Save(cache, filename));
+        assert(!rejected.Load(cache, filename));
+        assert(rejected.eventHeaders.empty());
+        remove(cache.c_str());
+    }
+    
+    void test_block_id_scan(std::string filename, std::string compressed)
+    {
+        RawStreamPtr stream = RawStream::Create(filename);
+        FileIndex index;
+        index.Scan(*stream, false);
+        ENSURE_EQUAL(stream->GetNBlocks(), 4725);
+        for (unsigned int threads = 1; threads != 4; ++threads)
+        {
+            FileIndex quick;
+            assert(quick.ScanBlockIDs(*stream, threads));
+            assert(quick.complete);
+            ENSURE_EQUAL(quick.runNumber, index.runNumber);
+            assert(quick.eventHeaders == index.eventHeaders);
+            assert(quick.eventTrailers == index.eventTrailers);
+            assert(quick.longBlocks == index.longBlocks);
+            assert(quick.IDToPosition == index.IDToPosition);
+        }
+        ENSURE_EQUAL(stream->GetNextPosition(), 0);
+        
+        FileIndex none;
+        assert(!none.ScanBlockIDs(*RawStream::Create(compressed)));
+    }
+    
+    int count_particles(ShowerFile& file)
+    {
+        auto& stream = file.GetCurrentShower().ParticleStream();
+        int count = 0;
+        while (stream.NextParticle()) ++count;
+        return count;
+    }
+    
+    void test_streaming(std::string filename)
+    {
+        ShowerFile file;
+        file.OpenStream(filename);
+        assert(file.IsStreaming());
+        ENSURE_EQUAL(file.GetRunHeader().fRunNumber, 2);
+        assert(file.NextEvent() == eSuccess);
+        assert(file.GetCurrentShower().GetPrimary() == 2212);
+        ENSURE_EQUAL(count_particles(file), 181992);
+        assert(file.FinishEvent() == eSuccess);
+        assert(file.GetCurrentShower().GetMuonNumber() == 1335);
+        assert(file.NextEvent() == eEOF);
+        ENSURE_EQUAL(file.GetNEvents(), 1);
+        
+        // the trailer is also found when the particles are skipped
+        file.OpenStream(filename);
+        assert(file.FindEvent(1) == eSuccess);
+        assert(file.FindEvent(1) == eSuccess);
+        assert(file.NextEvent() == eEOF);
+        assert(file.GetCurrentShower().GetMuonNumber() == 1335);
+    }
+    
+    void test_pipe(std::string filename)
+    {
+        const std::string fifo = "test_stream.fifo";
+        remove(fifo.c_str());
+        assert(mkfifo(fifo.c_str(), 0600) == 0);
+        std::thread writer([&]()
+        {
+            const std::string data = read_file(filename);
+            FILE* out = fopen(fifo.c_str(), "wb");
+            fwrite(data.data(), 1, data.size(), out);
+            fclose(out);
+        });
+        {
+            ShowerFile file(fifo);
+            assert(file.IsStreaming());
+            assert(file.FindEvent(1) == eSuccess);
+            ENSURE_EQUAL(count_particles(file), 181992);
+            assert(file.NextEvent() == eEOF);
+            assert(file.GetCurrentShower().GetMuonNumber() == 1335);
+        }
+        writer.join();
+        remove(fifo.c_str());
+    }
+    
+    void test_lazy_scan(std::string filename, std::string reopened)
+    {
+        RawStreamPtr stream = RawStream::Create(filename);
+        FileIndex index;
+        assert(index.ScanEvents(*stream, 1));
+        ENSURE_EQUAL(index.eventTrailers.size(), 1);
+        assert(!index.complete);
+        assert(!index.ScanEvents(*stream, 2));
+        assert(index.complete);
+        ENSURE_EQUAL(stream->GetNextPosition(), 0);
+        
+        FileIndex header;
+        assert(header.ScanUntil(*stream, [&header]() { return !header.eventHeaders.empty(); }));
+        ENSURE_EQUAL(header.eventHeaders.size(), 1);
+        assert(header.eventTrailers.empty() && !header.complete);
+        ENSURE_EQUAL(stream->GetNextPosition(), 0);
+        
+        // the .bz2 can only go back by decompressing it again, it is indexed whole on the first search
+        assert(!stream->SeeksByReopening());
+        assert(RawStream::Create(reopened)->SeeksByReopening());
+        const char* files[] = {filename.c_str(), reopened.c_str()};
+        for (int i = 0; i != 2; ++i)
+        {
+            ShowerFile file;
+            file.Open(files[i], false);
+            assert(file.FindEvent(1) == eSuccess);
+            assert(file.GetCurrentShower().GetMuonNumber() == 1335);
+            assert(file.FindEvent(2) == eFail);
+            ENSURE_EQUAL(file.GetNEvents(), 1);
+        }
+    }
+    
+    // ustar member header followed by the data, padded to 512 bytes
+    std::string tar_member(const std::string& name, const std::string& data)
+    {
+        char header[512] = {0};
+        strcpy(header, name.c_str());
+        sprintf(header + 100, "%07o", 0644);
+        sprintf(header + 124, "%011lo", (unsigned long)data.size());
+        sprintf(header + 136, "%011o", 0);
+        header[156] = '0';
+        memcpy(header + 257, "ustar\0" "00", 8);
+        memset(header + 148, ' ', 8);
+        unsigned int sum = 0;
+        for (int i = 0; i != 512; ++i) sum += (unsigned char)header[i];
+        sprintf(header + 148, "%06o", sum);
+        return std::string(header, 512) + data + std::string((512 - data.size() % 512) % 512, '\0');
+    }
+    
+    void test_archive(std::string filename)
+    {
+        const std::string data = read_file(filename);
+        const std::string archive = tar_member("./run000002/notes.txt", "odd size") +
+            tar_member("run000002/DAT000002-32", data) +
+            std::string(1024, '\0');
+        
+        FILE* tar = fopen("test_archive.tar", "wb");
+        fwrite(archive.data(), 1, archive.size(), tar);
+        fclose(tar);
+        gzFile tgz = gzopen("test_archive.tar.gz", "wb");
+        gzwrite(tgz, archive.data(), archive.size());
+        gzclose(tgz);
+        
+        const char* archives[] = {"test_archive.tar", "test_archive.tar.gz"};
+        for (int i = 0; i != 2; ++i)
+        {
+            const std::string member = std::string(archives[i]) + ":run000002/DAT000002-32";
+            FileStream* file = FileStream::open(member.c_str());
+            assert(file && file->seekable);
+            ENSURE_EQUAL(file->size(), data.size());
+            std::vector<char> bytes(1000);
+            assert(file->seek(4000000) && file->read(bytes.size(), &bytes[0]) == 1000);
+            assert(!memcmp(&bytes[0], &data[4000000], bytes.size()));
+            assert(file->seek(data.size() - 10) && file->read(bytes.size(), &bytes[0]) == 10); // not into the next member
+            delete file;
+            
+            test_header(member); // without a .long sibling in the archive
+            test_particles(member);
+            
+            assert(LongFile(std::string(archives[i]) + ":run000002/notes.txt").IsOpen());
+            assert(!LongFile(std::string(archives[i]) + ":run000002/DAT000002-32.long").IsOpen());
+        }
+        assert(!FileStream::open("test_archive.tar:notes.txt"));
+        
+        FileStream* notes = FileStream::open("test_archive.tar:run000002/notes.txt");
+        char text[100];
+        assert(notes && notes->read(sizeof(text), text) == 8 && !memcmp(text, "odd size", 8));
+        delete notes;
+        remove("test_archive.tar");
+        remove("test_archive.tar.gz");
+    }
+    
+    // the file twice, as from cat, the second time as run 3
+    void test_concatenated(std::string filename)
+    {
+        const std::string data = read_file(filename);
+        std::string second = data;
+        const float run = 3;
+        memcpy(&second[8], &run, sizeof(run)); // after the padding and "RUNH"
+        const std::string runs = "test_runs.dat";
+        FILE* out = fopen(runs.c_str(), "wb");
+        fwrite(data.data(), 1, data.size(), out);
+        fwrite(second.data(), 1, second.size(), out);
+        fclose(out);
+        
+        RawStreamPtr stream = RawStream::Create(runs);
+        FileIndex index;
+        index.Scan(*stream, false);
+        assert(index.complete);
+        ENSURE_EQUAL(index.runHeaders.size(), 2);
+        ENSURE_EQUAL(index.runHeaders[1], 4725);
+        ENSURE_EQUAL(index.runTrailers.size(), 2);
+        ENSURE_EQUAL(index.runNumbers[1], 3);
+        ENSURE_EQUAL(index.eventHeaders.size(), 2);
+        ENSURE_EQUAL(index.eventRuns[1], 1);
+        ENSURE_EQUAL(index.IDToPosition[1], 0);
+        ENSURE_EQUAL(index.RunEventToPosition[std::make_pair(3, 1u)], 1);
+        FileIndex quick;
+        assert(quick.ScanBlockIDs(*stream, 2));
+        assert(quick.complete);
+        assert(quick.runHeaders == index.runHeaders && quick.eventRuns == index.eventRuns);
+        assert(quick.RunEventToPosition == index.RunEventToPosition);
+        
+        const std::string cache = "test_runs.idx";
+        assert(index.Save(cache, runs));
+        FileIndex loaded;
+        assert(loaded.Load(cache, runs));
+        assert(loaded.runTrailers == index.runTrailers && loaded.eventNumbers == index.eventNumbers);
+        assert(loaded.RunEventToPosition == index.RunEventToPosition);
+        remove(cache.c_str());
+        
+        {
+            ShowerFile file(runs);
+            ENSURE_EQUAL(file.GetNRuns(), 2);
+            ENSURE_EQUAL(file.GetNEvents(), 2);
+            ENSURE_EQUAL(file.GetRunHeader(1).fRunNumber, 3);
+            assert(file.FindEvent(3, 1) == eSuccess);
+            ENSURE_EQUAL(file.GetRunHeader().fRunNumber, 3);
+            ENSURE_EQUAL(count_particles(file), 181992);
+            assert(file.FindEvent(1) == eSuccess);
+            ENSURE_EQUAL(file.GetRunHeader().fRunNumber, 2);
+            assert(file.GetCurrentShower().GetMuonNumber() == 1335);
+            assert(file.FindEvent(4, 1) == eFail);
+        }
+        {
+            ShowerFile file;
+            file.OpenStream(runs);
+            assert(file.NextEvent() == eSuccess);
+            ENSURE_EQUAL(file.GetRunHeader().fRunNumber, 2);
+            assert(file.FindEvent(3, 1) == eSuccess);
+            ENSURE_EQUAL(file.GetRunHeader().fRunNumber, 3);
+            ENSURE_EQUAL(count_particles(file), 181992);
+            assert(file.NextEvent() == eEOF);
+            assert(file.GetCurrentShower().GetMuonNumber() == 1335);
+            ENSURE_EQUAL(file.GetNRuns(), 2);
+            ENSURE_EQUAL(file.GetNEvents(), 2);
+        }
+        remove(runs.c_str());
+    }
 }
 void test_file(const char* directory)
 {
@@ -61,5 +421,23 @@ void test_file(const char* directory)
         std::cout << "testing particles " << dir << filenames[i] << std::endl;
         test_particles(dir + filenames[i]);
     }
+    std::cout << "testing particle records " << dir << filenames[0] << std::endl;
+    test_records(dir + filenames[0]);
+    std::cout << "testing particle list" << std::endl;
+    test_particle_list();
+    std::cout << "testing index cache " << dir << filenames[0] << std::endl;
+    test_index_cache(dir + filenames[0], dir + filenames[2]);
+    std::cout << "testing block ID scan " << dir << filenames[0] << std::endl;
+    test_block_id_scan(dir + filenames[0], dir + filenames[2]);
+    std::cout << "testing streaming " << dir << filenames[1] << std::endl;
+    test_streaming(dir + filenames[1]);
+    std::cout << "testing pipe " << dir << filenames[0] << std::endl;
+    test_pipe(dir + filenames[0]);
+    std::cout << "testing lazy scan " << dir << filenames[2] << std::endl;
+    test_lazy_scan(dir + filenames[2], dir + filenames[1]);
+    std::cout << "testing tar archive members " << dir << filenames[0] << std::endl;
+    test_archive(dir + filenames[0]);
+    std::cout << "testing concatenated runs " << dir << filenames[0] << std::endl;
+    test_concatenated(dir + filenames[0]);
     printf("TestCorsikaFile Successfull!\n");
 }
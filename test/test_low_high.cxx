@@ -33,8 +33,37 @@ void test_low_high(const char* dir)
     auto stream = shower.ParticleStream();
     
     ParticleInfo high;
+    size_t parents = 0, muon_infos = 0;
+    std::vector<float> grand_parents;
     while (auto p = stream.NextParticle())
+    {
         high.add(*p);
+        parents += p->HasParent();
+        muon_infos += p->HasMuonInfo();
+        if (p->HasParent()) grand_parents.push_back(p->GetGrandParent().fDescription);
+    }
+    assert(parents > 0 && muon_infos > 0);
+    
+    // the same without allocating
+    stream.Rewind();
+    ParticleData<Thinned> record;
+    ParticleHistory history;
+    size_t count = 0, records_with_parent = 0, records_with_muon_info = 0;
+    while (stream.NextParticle(record, history))
+    {
+        assert(record.fX == high.particles[count].x && record.fPx == high.particles[count].px);
+        if (history.fHasParent)
+        {
+            assert(history.fParent.fDescription < 0);
+            assert(history.fGrandParent.fDescription == grand_parents[records_with_parent]);
+            ++records_with_parent;
+        }
+        records_with_muon_info += history.fHasMuonInfo;
+        ++count;
+    }
+    ENSURE_EQUAL(count, high.num_particles);
+    ENSURE_EQUAL(records_with_parent, parents);
+    ENSURE_EQUAL(records_with_muon_info, muon_infos);
     
     assert(high.num_particles == 254188);
     assert(high.num_muons == 10338);
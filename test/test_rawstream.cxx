@@ -1,10 +1,17 @@
 #include "tests.h"
+#include <corsika/Verify.h>
+#include <corsika/FileIndex.h>
+#include <corsika/ParticleDecode.h>
+#include <bzlib.h>
+#include <string.h>
+#include <algorithm>
+#include <cmath>
 
 namespace
 {
-    void test_basic(std::string filename)
+    void test_basic(std::string filename, const FileStream::Options& options = FileStream::Options())
     {
-        RawStreamPtr stream = RawStream::Create(filename);
+        RawStreamPtr stream = RawStream::Create(filename, options);
         Block<corsika::NotThinned> block;
         stream->GetNextBlock(block);
         assert(block.IsRunHeader());
@@ -34,6 +41,411 @@ namespace
         }
         ENSURE_EQUAL(all, 183339);
         ENSURE_EQUAL(i, 181992);
+        
+        RawParticleStream<corsika::NotThinned> batches(stream, 2);
+        size_t batched = 0, largest = 0;
+        while (true)
+        {
+            ParticleSpan<corsika::NotThinned> span = batches.NextBatch();
+            if (span.empty()) break;
+            assert(span.size() <= kParticlesInDiskBlock);
+            largest = std::max(largest, span.size());
+            batched += span.size();
+        }
+        ENSURE_EQUAL(batched, 183339);
+        ENSURE_EQUAL(largest, kParticlesInDiskBlock);
+        assert(batches.NextBatch().empty()); // stays at the end
+        assert(batches.NextBatch().empty());
+    }
+    
+    void test_view(std::string filename, const FileStream::Options& options = FileStream::Options())
+    {
+        RawStreamPtr copying = RawStream::Create(filename);
+        RawStreamPtr viewing = RawStream::Create(filename, options);
+        ENSURE_EQUAL(check_same_blocks(*copying, *viewing), 4725);
+        assert(!viewing->GetNextBlockView<corsika::Thinned>());
+    }
+    
+    void test_seek(std::string plain, std::string compressed, const FileStream::Options& options)
+    {
+        FileStream* reference = FileStream::open(plain.c_str());
+        FileStream* file = FileStream::open(compressed.c_str(), options);
+        assert(reference && file && file->seekable);
+        std::vector<char> expected(100000), data(100000);
+        // backwards through the file, then forward jumps across access points
+        const size_t positions[] = {4000000, 3000000, 2500000, 1000000, 123456, 0, 70000, 3900000, 4100000};
+        for (unsigned int i = 0; i != sizeof(positions) / sizeof(positions[0]); ++i)
+        {
+            assert(reference->seek(positions[i]));
+            assert(file->seek(positions[i]));
+            long n = reference->read(expected.size(), &expected[0]);
+            ENSURE_EQUAL(file->read(data.size(), &data[0]), n);
+            assert(memcmp(&expected[0], &data[0], n) == 0);
+        }
+        delete file;
+        delete reference;
+    }
+    
+    // the file in several bzip2 streams one after the other, as written by parallel compressors
+    void test_bz2_streams(std::string filename, const FileStream::Options& options)
+    {
+        const std::string copy = "test_streams.bz2";
+        std::string data = read_file(filename);
+        FILE* out = fopen(copy.c_str(), "wb");
+        const size_t kStream = 1500000; // not a multiple of the bzip2 block size
+        for (size_t i = 0; i < data.size(); i += kStream)
+        {
+            int error;
+            BZFILE* bz = BZ2_bzWriteOpen(&error, out, 9, 0, 0);
+            BZ2_bzWrite(&error, bz, &data[i], std::min(kStream, data.size() - i));
+            BZ2_bzWriteClose(&error, bz, 0, 0, 0);
+            assert(error == BZ_OK);
+        }
+        fclose(out);
+        
+        RawStreamPtr reference = RawStream::Create(filename);
+        RawStreamPtr stream = RawStream::Create(copy, options);
+        ENSURE_EQUAL(check_same_blocks(*reference, *stream), 4725);
+        remove(copy.c_str());
+    }
+    
+    bool recording = false;
+    std::vector<std::string> opened;
+    FileStream* recording_factory(const FileStream::Probe& probe, const FileStream::Options& options)
+    {
+        if (recording)
+            opened.push_back(probe.filename);
+        return 0;
+    }
+    
+    void test_sniffing(std::string compressed)
+    {
+        // a compressed file without the usual suffix
+        const std::string copy = "test_sniffing.dat";
+        const std::string data = read_file(compressed);
+        FILE* out = fopen(copy.c_str(), "wb");
+        fwrite(data.data(), 1, data.size(), out);
+        fclose(out);
+        
+        static bool registered = false;
+        if (!registered)
+            FileStream::register_factory(recording_factory);
+        registered = true;
+        recording = true;
+        test_basic(copy);
+        recording = false;
+        assert(!opened.empty() && opened[0] == copy); // registered factories are asked first
+        opened.clear();
+        remove(copy.c_str());
+    }
+    
+    // the file as written on a machine of the other byte order: every word but the block IDs swapped
+    void test_swapped(std::string filename)
+    {
+        const std::string swapped = "test_swapped.dat";
+        FILE* in = fopen(filename.c_str(), "rb");
+        FILE* out = fopen(swapped.c_str(), "wb");
+        uint32_t word;
+        while (fread(&word, 4, 1, in) == 1)
+        {
+            const char* id = (const char*)&word;
+            if (strncmp(id, "RUNH", 4) && strncmp(id, "EVTH", 4) && strncmp(id, "LONG", 4) &&
+                strncmp(id, "EVTE", 4) && strncmp(id, "RUNE", 4))
+                word = __builtin_bswap32(word);
+            fwrite(&word, 4, 1, out);
+        }
+        fclose(out);
+        fclose(in);
+        
+        test_basic(swapped);
+        RawStreamPtr reference = RawStream::Create(filename);
+        RawStreamPtr stream = RawStream::Create(swapped);
+        ENSURE_EQUAL(check_same_blocks(*reference, *stream), 4725);
+        
+        std::vector<RawStream::BlockInfo> expected(100), info(100);
+        ENSURE_EQUAL(stream->GetBlockIDs(0, 100, &info[0]), 100);
+        reference->GetBlockIDs(0, 100, &expected[0]);
+        for (size_t b = 0; b != info.size(); ++b)
+            assert(!memcmp(&info[b], &expected[b], sizeof(info[b])));
+        remove(swapped.c_str());
+    }
+    
+    // The sub-blocks of a file with 32bit padding, written again in records of record_size bytes
+    template <class Marker> void write_records(std::string filename, std::string copy, size_t record_size, bool swap)
+    {
+        std::string contents;
+        FILE* in = fopen(filename.c_str(), "rb");
+        std::vector<char> disk_block(4 + kSubBlocksPerBlock * sizeof(Block<corsika::NotThinned>) + 4);
+        while (fread(&disk_block[0], 1, disk_block.size(), in) == disk_block.size())
+            contents.append(&disk_block[4], disk_block.size() - 8);
+        fclose(in);
+        if (swap)
+        {
+            for (size_t i = 0; i < contents.size(); i += 4)
+            {
+                char* word = &contents[i];
+                if (strncmp(word, "RUNH", 4) && strncmp(word, "EVTH", 4) && strncmp(word, "LONG", 4) &&
+                    strncmp(word, "EVTE", 4) && strncmp(word, "RUNE", 4))
+                    std::reverse(word, word + 4);
+            }
+        }
+        FILE* out = fopen(copy.c_str(), "wb");
+        for (size_t i = 0; i < contents.size(); i += record_size)
+        {
+            Marker marker = std::min(record_size, contents.size() - i);
+            if (swap) std::reverse((char*)&marker, (char*)&marker + sizeof(marker));
+            fwrite(&marker, sizeof(marker), 1, out);
+            fwrite(&contents[i], 1, std::min(record_size, contents.size() - i), out);
+            fwrite(&marker, sizeof(marker), 1, out);
+        }
+        fclose(out);
+    }
+    
+    void test_framing(std::string filename)
+    {
+        const std::string copy = "test_framing.dat";
+        for (int layout = 0; layout != 3; ++layout)
+        {
+            if (layout == 0) write_records<int32_t>(filename, copy, 7 * sizeof(Block<corsika::NotThinned>), false); // other MAXBUF
+            if (layout == 1) write_records<int64_t>(filename, copy, 1000, false); // sub-blocks split over records
+            if (layout == 2) write_records<int64_t>(filename, copy, 5000, true);
+            
+            RawStreamPtr reference = RawStream::Create(filename);
+            RawStreamPtr stream = RawStream::Create(copy);
+            assert(!stream->IsThinned());
+            ENSURE_EQUAL(check_same_blocks(*reference, *stream), 4725);
+            
+            Block<corsika::NotThinned> block;
+            const size_t positions[] = {4000, 22, 1, 4724, 2100};
+            for (unsigned int p = 0; p != sizeof(positions) / sizeof(positions[0]); ++p)
+            {
+                reference->SeekTo(positions[p]);
+                stream->SeekTo(positions[p]);
+                reference->GetNextBlock(block);
+                assert(memcmp(stream->GetNextBlockView<corsika::NotThinned>(), &block, sizeof(block)) == 0);
+            }
+            if (layout == 1) test_basic(copy);
+        }
+        remove(copy.c_str());
+    }
+    
+    void test_advice(std::string filename, std::string compressed)
+    {
+        FileStream* mapped = FileStream::open(filename.c_str());
+        assert(mapped->advise(FileStream::kSequential));
+        assert(mapped->advise(FileStream::kRandom, 5000, 100000));
+        assert(mapped->advise(FileStream::kWillNeed, 100));
+        assert(mapped->advise(FileStream::kDontNeed));
+        delete mapped;
+        
+        // no file underneath
+        const std::string data = read_file(filename);
+        FileStream* memory = FileStream::open_memory(data.data(), data.size());
+        assert(!memory->advise(FileStream::kSequential));
+        delete memory;
+        FileStream* gz = FileStream::open(compressed.c_str());
+        assert(!gz->advise(FileStream::kWillNeed));
+        delete gz;
+        
+        // a range of blocks asked for ahead, then read from its middle on, dropping the pages behind
+        RawStreamPtr stream = RawStream::Create(filename);
+        RawStreamPtr reference = RawStream::Create(filename);
+        stream->Advise(FileStream::kWillNeed, 1000, 500);
+        stream->Advise(FileStream::kSequential, 1000);
+        stream->SetDropBehind(true);
+        stream->SeekTo(1234);
+        reference->SeekTo(1234);
+        ENSURE_EQUAL(check_same_blocks(*reference, *stream), 4725 - 1234);
+    }
+    
+    // the asynchronous reader, not the stdio fallback, which has no view()
+    void test_async(std::string filename, const FileStream::Options& options)
+    {
+        FileStream* reference = FileStream::open(filename.c_str());
+        FileStream* file = FileStream::open(filename.c_str(), options);
+        assert(file);
+        std::vector<char> bytes(22940);
+        ENSURE_EQUAL(reference->read(bytes.size(), &bytes[0]), long(bytes.size()));
+        const void* view = file->view(bytes.size());
+        assert(view && memcmp(view, &bytes[0], bytes.size()) == 0);
+        assert(file->advise(FileStream::kSequential));
+        delete file;
+        delete reference;
+    }
+    
+    void test_memory(std::string filename)
+    {
+        boost::shared_ptr<std::string> data(new std::string(read_file(filename)));
+        
+        // the stream keeps the buffer alive
+        RawStreamPtr stream = RawStream::Create(&(*data)[0], data->size(), boost::shared_ptr<const void>(data, &(*data)[0]));
+        const char* begin = &(*data)[0];
+        const char* end = begin + data->size();
+        data.reset();
+        
+        RawStreamPtr reference = RawStream::Create(filename);
+        assert(stream->IsSeekable());
+        ENSURE_EQUAL(stream->GetNBlocks(), 4725);
+        ENSURE_EQUAL(check_same_blocks(*reference, *stream), 4725);
+        
+        // past the first disk block, which is copied while checking the header, views point into the buffer
+        for (size_t position = kSubBlocksPerBlock; position < 4725; position += 1000)
+        {
+            stream->SeekTo(position);
+            const char* view = (const char*)stream->GetNextBlockView<corsika::NotThinned>();
+            assert(view > begin && view < end);
+        }
+        
+        Block<corsika::NotThinned> block;
+        stream->SeekTo(1);
+        reference->SeekTo(1);
+        reference->GetNextBlock(block);
+        assert(memcmp(stream->GetNextBlockView<corsika::NotThinned>(), &block, sizeof(block)) == 0);
+        
+        bool thrown = false;
+        try { RawStream::Create(begin + 1, 1000); } catch (IOException&) { thrown = true; }
+        assert(thrown);
+    }
+    
+    void test_verify(std::string filename, std::string compressed)
+    {
+        const std::string data = read_file(filename);
+        
+        // random access gives what is read in order
+        RawStreamPtr stream = RawStream::Create(filename);
+        std::vector<Block<NotThinned> > blocks(100);
+        std::vector<size_t> bad;
+        ENSURE_EQUAL(stream->GetBlocks(10, blocks.size(), &blocks[0], bad), blocks.size());
+        assert(bad.empty());
+        std::vector<Block<Thinned> > thinned(1);
+        ENSURE_EQUAL(stream->GetBlocks(0, 1, &thinned[0], bad), 0);
+        stream->SeekTo(10);
+        for (size_t i = 0; i != blocks.size(); ++i)
+            assert(!memcmp(stream->GetNextBlockView<NotThinned>(), &blocks[i], sizeof(blocks[i])));
+        
+        for (unsigned int threads = 1; threads != 4; ++threads)
+        {
+            const VerifyReport report = Verify(filename, threads);
+            assert(report.IsValid());
+            ENSURE_EQUAL(report.fBlocks, 4725);
+            ENSURE_EQUAL(report.fRuns, 1);
+            ENSURE_EQUAL(report.fEvents, 1);
+            ENSURE_EQUAL(report.fParticles, 181992 + 1335); // and the additional muon information
+        }
+        const VerifyReport sequential = Verify(compressed);
+        assert(sequential.IsValid());
+        ENSURE_EQUAL(sequential.fParticles, 181992 + 1335);
+        assert(!Verify("no_such_file").IsValid());
+        
+        FileIndex index;
+        index.Scan(*stream, false);
+        const size_t kDiskBlock = 4 + kSubBlocksPerBlock * sizeof(Block<NotThinned>) + 4;
+        auto offset = [&](size_t position)
+        {
+            return position / kSubBlocksPerBlock * kDiskBlock + 4 + position % kSubBlocksPerBlock * sizeof(Block<NotThinned>);
+        };
+        const size_t trailer = offset(index.eventTrailers[0]);
+        const size_t runTrailer = offset(4725 - kSubBlocksPerBlock);
+        assert(!memcmp(&data[runTrailer], "RUNE", 4)); // first in the last disk block
+        
+        {
+            std::string damaged(data);
+            damaged[10 * kDiskBlock] ^= 1;
+            const float nan = NAN;
+            memcpy(&damaged[offset(5) + 8], &nan, 4);
+            const VerifyReport report = Verify(*RawStream::Create(&damaged[0], damaged.size()), 2);
+            ENSURE_EQUAL(report.fNErrors, 2);
+            ENSURE_EQUAL(report.fNonFinite, 1);
+            ENSURE_EQUAL(report.fErrors[0], "block 5: 1 particle words are NaN or infinite");
+            ENSURE_EQUAL(report.fErrors[1], "block 210: record markers do not match the length of a disk block");
+        }
+        {
+            std::string damaged(data);
+            memcpy(&damaged[trailer], "XXXX", 4);
+            const VerifyReport report = Verify(*RawStream::Create(&damaged[0], damaged.size()), 2);
+            ENSURE_EQUAL(report.fNErrors, 1);
+            assert(report.fErrors[0].find("run 2 ends inside event 1") != std::string::npos);
+        }
+        {
+            std::string damaged(data);
+            const float events = 2;
+            memcpy(&damaged[runTrailer + 8], &events, 4);
+            const VerifyReport report = Verify(*RawStream::Create(&damaged[0], damaged.size()), 2);
+            ENSURE_EQUAL(report.fNErrors, 1);
+            assert(report.fErrors[0].find("run 2 has 1 events, its trailer says 2") != std::string::npos);
+        }
+        {
+            const VerifyReport report = Verify(*RawStream::Create(&data[0], 100 * kDiskBlock), 2);
+            ENSURE_EQUAL(report.fNErrors, 1);
+            ENSURE_EQUAL(report.fErrors[0], "block 2100: the file ends inside event 1");
+        }
+    }
+    
+    void check_decoded(const ParticleData<Thinned>* particles, size_t n, const DecodedParticles& decoded)
+    {
+        for (size_t i = 0; i != n; ++i)
+        {
+            Particle p(particles[i]);
+            p.fDescription = std::fabs(p.fDescription);
+            ENSURE_EQUAL(decoded.fCorsikaCode[i], p.CorsikaCode());
+            ENSURE_EQUAL(decoded.fPDGCode[i], p.PDGCode());
+            ENSURE_EQUAL(decoded.fHadronicGeneration[i], p.HadronicGeneration());
+            ENSURE_EQUAL(decoded.fObservingLevel[i], p.ObservingLevel());
+            ENSURE_EQUAL(decoded.fKineticEnergy[i], p.KineticEnergy());
+        }
+    }
+    
+    void test_decode(std::string filename)
+    {
+        RawStreamPtr stream = RawStream::Create(filename);
+        Block<NotThinned> block;
+        stream->GetNextBlock(block); // RUNH
+        stream->GetNextBlock(block); // EVTH
+        const RawParticleStreamPtr particles = VRawParticleStream::Create(stream);
+        ParticleData<Thinned> batch[kParticlesInBlock];
+        DecodedParticles decoded;
+        size_t count = 0;
+        while (size_t n = particles->NextParticlesData(batch, kParticlesInBlock))
+        {
+            DecodeParticles(batch, n, decoded);
+            check_decoded(batch, n, decoded);
+            count += n;
+        }
+        assert(count > 0);
+        
+        // without the energies
+        DecodeParticles(batch, kParticlesInBlock, decoded);
+        DecodedParticles ids;
+        std::fill(ids.fKineticEnergy, ids.fKineticEnergy + kParticlesInBlock, -1.f);
+        DecodeParticles(batch, kParticlesInBlock, ids, false);
+        for (size_t i = 0; i != kParticlesInBlock; ++i)
+        {
+            ENSURE_EQUAL(ids.fPDGCode[i], decoded.fPDGCode[i]);
+            ENSURE_EQUAL(ids.fObservingLevel[i], decoded.fObservingLevel[i]);
+            ENSURE_EQUAL(ids.fKineticEnergy[i], -1.f);
+        }
+        
+        // every level, generation and code with a particle, nucleus or Cherenkov description
+        const int codes[] = {0, 1, 3, 5, 6, 13, 14, 75, 96, 99, 100, 201, 402, 5626, 9899, 9900, 9999};
+        for (size_t c = 0; c != sizeof(codes) / sizeof(codes[0]); ++c)
+        {
+            for (int generation = 0; generation < 100; generation += 3)
+            {
+                for (size_t i = 0; i != kParticlesInBlock; ++i)
+                {
+                    const int level = i % 10;
+                    batch[i].fDescription = (i % 2 ? -1 : 1) * (codes[c] * 1000 + generation * 10 + level);
+                    batch[i].fPx = 0.1 * i * generation;
+                    batch[i].fPy = -0.2 * level;
+                    batch[i].fPz = 3.5 * i;
+                }
+                for (size_t n = 0; n <= kParticlesInBlock; n += 13)
+                {
+                    DecodeParticles(batch, n, decoded);
+                    check_decoded(batch, n, decoded);
+                }
+            }
+        }
     }
 }
 void test_rawstream(const char* directory)
@@ -45,7 +457,75 @@ void test_rawstream(const char* directory)
     {
         std::cout << "testing raw stream " << filenames[i] << std::endl;
         test_basic(dir + filenames[i]);
+        test_view(dir + filenames[i]);
     }
+    
+    FileStream::Options read_ahead;
+    read_ahead.read_ahead = 4;
+    std::cout << "testing raw stream with read-ahead /DAT000002-32.bz2" << std::endl;
+    test_basic(dir + "/DAT000002-32.bz2", read_ahead);
+    
+    FileStream::Options threads;
+    threads.threads = 4;
+    std::cout << "testing raw stream with parallel bzip2 /DAT000002-32.bz2" << std::endl;
+    test_basic(dir + "/DAT000002-32.bz2", threads);
+    test_view(dir + "/DAT000002-32.bz2", threads);
+    test_bz2_streams(dir + "/DAT000002-32", threads);
+    
+    FileStream::Options index;
+    index.gz_index_span = 1 << 16;
+    std::cout << "testing seeks in /DAT000002-32.gz" << std::endl;
+    test_seek(dir + "/DAT000002-32", dir + "/DAT000002-32.gz", index);
+    test_basic(dir + "/DAT000002-32.gz", index);
+    
+    FileStream::Options async;
+    async.queue_depth = 4;
+    std::cout << "testing asynchronous reads /DAT000002-32" << std::endl;
+    test_async(dir + "/DAT000002-32", async);
+    test_basic(dir + "/DAT000002-32", async);
+    test_view(dir + "/DAT000002-32", async);
+    test_seek(dir + "/DAT000002-32", dir + "/DAT000002-32", async);
+    
+    std::cout << "testing byte-swapped /DAT000002-32" << std::endl;
+    test_swapped(dir + "/DAT000002-32");
+    
+    std::cout << "testing other record layouts /DAT000002-32" << std::endl;
+    test_framing(dir + "/DAT000002-32");
+    
+    std::cout << "testing access advice /DAT000002-32" << std::endl;
+    test_advice(dir + "/DAT000002-32", dir + "/DAT000002-32.gz");
+    
+    std::cout << "testing raw stream in memory /DAT000002-32" << std::endl;
+    test_memory(dir + "/DAT000002-32");
+    
+    std::cout << "testing integrity check /DAT000002-32" << std::endl;
+    test_verify(dir + "/DAT000002-32", dir + "/DAT000002-32.gz");
+    
+    std::cout << "testing particle decoding /DAT000002-32" << std::endl;
+    test_decode(dir + "/DAT000002-32");
+    test_decode(dir + "/DAT000011-proton-EHISTORY-MUPROD");
+    
+    std::cout << "testing format detection" << std::endl;
+    test_sniffing(dir + "/DAT000002-32.bz2");
+    test_sniffing(dir + "/DAT000002-32.gz");
+#ifdef CORSIKA_HAVE_LZMA
+    test_sniffing(dir + "/DAT000002-32.xz");
+#endif
+#ifdef CORSIKA_HAVE_ZSTD
+    test_sniffing(dir + "/DAT000002-32.zst");
+#endif
+    
+#ifdef CORSIKA_HAVE_LZMA
+    std::cout << "testing raw stream /DAT000002-32.xz" << std::endl;
+    test_basic(dir + "/DAT000002-32.xz");
+#endif
+#ifdef CORSIKA_HAVE_ZSTD
+    std::cout << "testing raw stream /DAT000002-32.zst" << std::endl;
+    test_basic(dir + "/DAT000002-32.zst");
+    test_view(dir + "/DAT000002-32.zst");
+    std::cout << "testing seeks in /DAT000002-32.zst" << std::endl;
+    test_seek(dir + "/DAT000002-32", dir + "/DAT000002-32.zst", FileStream::Options());
+#endif
     //assert(Verify<CloseTo>(p.GetCoordinates(CTrans), Triple(-1,0,0)));
     printf("TestRawStream Successfull!\n");
 }
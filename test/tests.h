@@ -3,13 +3,46 @@
 #include <corsika/RawStream.h>
 #include <corsika/Block.h>
 #include <corsika/ShowerFile.h>
+#include <corsika/RawParticleStream.h>
 #include <corsika/Units.h>
 #include <corsika/Index.h>
 #include <string>
 #include <vector>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
 #define ENSURE_EQUAL(a, b, ...) assert(a == b)
 using namespace corsika;
 
+/// The whole contents of a file
+inline std::string read_file(const std::string& filename)
+{
+    std::string data;
+    FILE* in = fopen(filename.c_str(), "rb");
+    assert(in);
+    std::vector<char> buffer(1 << 16);
+    while (size_t n = fread(&buffer[0], 1, buffer.size(), in))
+        data.append(&buffer[0], n);
+    fclose(in);
+    return data;
+}
+
+/// Read theStream through views to the end, comparing every block with a copy from theReference.
+/// Returns the number of blocks
+inline size_t check_same_blocks(RawStream& theReference, RawStream& theStream)
+{
+    Block<NotThinned> block;
+    size_t i = 0;
+    while (theReference.GetNextBlock(block))
+    {
+        const Block<NotThinned>* view = theStream.GetNextBlockView<NotThinned>();
+        assert(view && memcmp(view, &block, sizeof(block)) == 0);
+        ++i;
+    }
+    assert(!theStream.GetNextBlockView<NotThinned>());
+    return i;
+}
+
 void test_low_high(const char* dir);
 void test_file(const char* directory);
 void test_rawstream(const char* directory);